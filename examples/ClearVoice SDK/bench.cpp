@@ -0,0 +1,186 @@
+#include "immersitech_clearvoice.h"
+#include "audiofile.h"
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#ifndef IMM_AUDIO_FILES_DIR
+#define IMM_AUDIO_FILES_DIR "../../audio_files"
+#endif
+
+/*
+
+This command line tool measures how fast ClearVoice runs at every supported sample rate.
+
+The bundled audio files are resampled to 8, 16, 24, 32 and 48 kHz. At each rate a fresh handle
+processes a number of warm-up frames, then a fixed number of timed frames, on a thread pinned
+to one CPU. The results are printed to stdout as JSON so they can be stored and compared.
+
+SYNTAX:
+clearvoice_bench <licensefile> [--audio-dir DIR] [--frames N] [--warmup N] [--cpu N]
+
+*/
+
+static const int sample_rates[] = { 8000, 16000, 24000, 32000, 48000 };
+
+// Linear interpolation is plenty to give ClearVoice realistic speech at each rate
+static std::vector<float> resample(const std::vector<float>& input, int input_rate, int output_rate)
+{
+    size_t output_length = (size_t)((double)input.size() * output_rate / input_rate);
+    std::vector<float> output(output_length);
+    double step = (double)input_rate / output_rate;
+    for (size_t i = 0; i < output_length; i++) {
+        double position = i * step;
+        size_t index = (size_t)position;
+        double fraction = position - index;
+        float next = index + 1 < input.size() ? input[index + 1] : input[index];
+        output[i] = (float)((1.0 - fraction) * input[index] + fraction * next);
+    }
+    return output;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: \nclearvoice_bench <licensefile> [--audio-dir DIR] [--frames N] [--warmup N] [--cpu N]" << std::endl;
+        std::cerr << "  --audio-dir DIR   Folder with the WAV files to process (default: the bundled audio_files)" << std::endl;
+        std::cerr << "  --frames N        Timed 10ms frames per sample rate (default 6000)" << std::endl;
+        std::cerr << "  --warmup N        Untimed 10ms frames before timing starts (default 200)" << std::endl;
+        std::cerr << "  --cpu N           CPU to pin the benchmark thread to, -1 to not pin (default 0)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    std::string audio_dir = IMM_AUDIO_FILES_DIR;
+    int timed_frames = 6000;
+    int warmup_frames = 200;
+    int cpu = 0;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--audio-dir") == 0 && a + 1 < argc) {
+            audio_dir = argv[++a];
+        }
+        else if (strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+            timed_frames = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--warmup") == 0 && a + 1 < argc) {
+            warmup_frames = std::max(0, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--cpu") == 0 && a + 1 < argc) {
+            cpu = atoi(argv[++a]);
+        }
+        else {
+            std::cerr << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+
+    // Load the first channel of every WAV file in the folder, one after the other
+    std::vector<std::string> paths;
+    std::error_code dir_error;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(audio_dir, dir_error)) {
+        if (entry.path().extension() == ".wav") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty()) {
+        std::cerr << "No WAV files found in " << audio_dir << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<float>> sources;
+    std::vector<int> source_rates;
+    for (const std::string& path : paths) {
+        AudioFile<float> file;
+        if (file.load(path) == false) {
+            std::cerr << "Failed to load input file " << path << std::endl;
+            return 1;
+        }
+        sources.push_back(file.samples[0]);
+        source_rates.push_back(file.getSampleRate());
+    }
+
+    bool pinned = pin_current_thread(cpu);
+    if (cpu >= 0 && !pinned) {
+        std::cerr << "Could not pin the benchmark thread to CPU " << cpu << ", results may be noisier" << std::endl;
+    }
+
+    std::cout << "{\n  \"benchmark\": \"clearvoice\",\n  \"timed_frames\": " << timed_frames
+              << ",\n  \"warmup_frames\": " << warmup_frames
+              << ",\n  \"cpu\": " << (pinned ? cpu : -1)
+              << ",\n  \"results\": [";
+
+    bool first_result = true;
+    for (int sample_rate : sample_rates) {
+        int buffer_size = sample_rate / 100; // ClearVoice always processes using 10ms buffers
+
+        std::vector<float> audio;
+        for (size_t i = 0; i < sources.size(); i++) {
+            std::vector<float> converted = resample(sources[i], source_rates[i], sample_rate);
+            audio.insert(audio.end(), converted.begin(), converted.end());
+        }
+        int available_frames = (int)(audio.size() / buffer_size);
+        if (available_frames == 0) {
+            std::cerr << "Not enough audio to benchmark at " << sample_rate << " Hz" << std::endl;
+            return 1;
+        }
+
+        imm_cv_config config = imm_cv_get_default_config();
+        config.input_sample_rate = sample_rate;
+        config.output_sample_rate = sample_rate;
+        imm_error_code error_code;
+        imm_cv_handle handle = imm_cv_init_from_file(license_filepath, config, &error_code);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cerr << "imm_cv_init_from_file failed at " << sample_rate << " Hz with error code " << error_code << std::endl;
+            return 1;
+        }
+
+        // The audio is looped if there is not enough of it
+        std::vector<float> output(buffer_size);
+        std::vector<double> frame_ns(timed_frames);
+        imm_cv_output_metadata metadata;
+        for (int f = 0; f < warmup_frames; f++) {
+            imm_cv_process(handle, &audio[(size_t)(f % available_frames) * buffer_size], output.data(), &metadata);
+        }
+
+        std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+        for (int f = 0; f < timed_frames; f++) {
+            const float* in = &audio[(size_t)((warmup_frames + f) % available_frames) * buffer_size];
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            imm_cv_process(handle, in, output.data(), &metadata);
+            frame_ns[f] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+        std::sort(frame_ns.begin(), frame_ns.end());
+        double mean_ns = 0;
+        for (double ns : frame_ns) {
+            mean_ns += ns;
+        }
+        mean_ns /= timed_frames;
+        double audio_seconds = timed_frames * 0.01;
+
+        std::cout << (first_result ? "\n" : ",\n")
+                  << "    { \"sample_rate\": " << sample_rate
+                  << ", \"frame_size\": " << buffer_size
+                  << ", \"seconds\": " << seconds
+                  << ", \"frames_per_second\": " << timed_frames / seconds
+                  << ", \"real_time_factor\": " << seconds / audio_seconds
+                  << ", \"ns_per_frame_mean\": " << mean_ns
+                  << ", \"ns_per_frame_p50\": " << frame_ns[timed_frames / 2]
+                  << ", \"ns_per_frame_p99\": " << frame_ns[std::min(timed_frames - 1, (int)(timed_frames * 0.99))]
+                  << ", \"ns_per_frame_max\": " << frame_ns[timed_frames - 1] << " }";
+        first_result = false;
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+A small pool of worker threads that run one task per worker per 10ms frame.
+
+run_frame() hands the current frame index to every worker (the calling thread acts as
+worker 0) and only returns once all of them are done, so every channel is at the same
+sample position when the next frame starts.
+
+*/
+class FramePool
+{
+public:
+    typedef std::function<void(int worker, int frame)> Task;
+
+    FramePool(int num_workers, Task task)
+        : task(task), num_workers(num_workers < 1 ? 1 : num_workers)
+    {
+        for (int w = 1; w < this->num_workers; w++) {
+            threads.emplace_back(&FramePool::worker_loop, this, w);
+        }
+    }
+
+    ~FramePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        start_cv.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    int get_num_workers() const { return num_workers; }
+
+    void run_frame(int frame)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current_frame = frame;
+            remaining = num_workers - 1;
+            generation++;
+        }
+        start_cv.notify_all();
+
+        task(0, frame);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this] { return remaining == 0; });
+    }
+
+private:
+    void worker_loop(int worker)
+    {
+        unsigned long long seen = 0;
+        while (true) {
+            int frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&] { return generation != seen; });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+                frame = current_frame;
+            }
+
+            task(worker, frame);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                remaining--;
+            }
+            done_cv.notify_one();
+        }
+    }
+
+    Task task;
+    int num_workers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    unsigned long long generation = 0;
+    int current_frame = 0;
+    int remaining = 0;
+    bool stopping = false;
+};
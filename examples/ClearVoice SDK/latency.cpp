@@ -0,0 +1,110 @@
+#include "immersitech_clearvoice.h"
+#include "frame_reblocker.h"
+#include "latency_probe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <vector>
+
+/*
+
+This command line tool measures how many samples of delay ClearVoice adds, on its own and
+together with the reblocking a host needs when its block size is not a multiple of 10ms.
+
+At every supported sample rate, and for every host block size, a probe signal is run through a
+fresh ClearVoice handle behind a FrameReblocker, the same way clearvoice_demo processes a file.
+The output is cross-correlated with the probe and the delay is printed in samples and in
+milliseconds, next to the part of it that is caused by the reblocking alone. A block size of 0
+stands for 10ms, which is ClearVoice by itself.
+
+SYNTAX:
+clearvoice_latency <licensefile> [--signal chirp|impulse] [--block N] ...
+
+*/
+
+static const int sample_rates[] = { 8000, 16000, 24000, 32000, 48000 };
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \nclearvoice_latency <licensefile> [--signal chirp|impulse] [--block N] ..." << std::endl;
+        std::cout << "  --signal S   Probe signal, chirp (default) or impulse" << std::endl;
+        std::cout << "  --block N    Host block size in samples to measure, may be repeated (default 0 128 256 512, 0 = 10ms)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    ProbeSignal signal = PROBE_CHIRP;
+    std::vector<int> block_sizes;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--signal") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "impulse") == 0) {
+                signal = PROBE_IMPULSE;
+            }
+            else if (strcmp(argv[a], "chirp") != 0) {
+                std::cout << "Unknown signal " << argv[a] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--block") == 0 && a + 1 < argc) {
+            block_sizes.push_back(std::max(0, atoi(argv[++a])));
+        }
+        else {
+            std::cout << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+    if (block_sizes.empty()) {
+        block_sizes = { 0, 128, 256, 512 };
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%12s %10s %12s %16s %16s %12s %12s",
+             "sample rate", "block", "frame", "reblocking", "total delay", "delay (ms)", "correlation");
+    std::cout << line << std::endl;
+
+    for (int sample_rate : sample_rates) {
+        int buffer_size = sample_rate / 100; // ClearVoice always processes using 10ms buffers
+        std::vector<float> probe = make_latency_probe(signal, sample_rate);
+        int num_samples = (int)probe.size();
+
+        for (int requested_block : block_sizes) {
+            int block_size = requested_block > 0 ? requested_block : buffer_size;
+
+            imm_cv_config config = imm_cv_get_default_config();
+            config.input_sample_rate = sample_rate;
+            config.output_sample_rate = sample_rate;
+            imm_error_code error_code;
+            imm_cv_handle handle = imm_cv_init_from_file(license_filepath, config, &error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                std::cout << "imm_cv_init_from_file failed at " << sample_rate << " Hz with error code " << error_code << std::endl;
+                return 1;
+            }
+
+            // Keep the output as it comes out of the reblocker, delay included
+            FrameReblocker reblocker(buffer_size, block_size);
+            std::vector<float> output(num_samples);
+            imm_cv_output_metadata metadata;
+            for (int s = 0; s < num_samples; s += block_size) {
+                int n = std::min(block_size, num_samples - s);
+                reblocker.process(&probe[s], &output[s], n, [&](const float* in, float* out) {
+                    imm_cv_process(handle, in, out, &metadata);
+                });
+            }
+
+            DelayEstimate estimate = estimate_delay(probe, output, sample_rate / 2);
+            snprintf(line, sizeof(line), "%12d %10d %12d %16d %16d %12.2f %12.3f",
+                     sample_rate, block_size, buffer_size, reblocker.get_latency(), estimate.samples,
+                     estimate.samples * 1000.0 / sample_rate, estimate.correlation);
+            std::cout << line << std::endl;
+        }
+    }
+    std::cout << "A correlation well below 1 means the output no longer resembles the probe, and its delay is not reliable." << std::endl;
+
+    return 0;
+}
@@ -1,13 +1,194 @@
+#define IMM_ALLOC_TRACKER_IMPLEMENTATION
+#define IMM_RT_CHECKER_IMPLEMENTATION
 #include "immersitech_clearvoice.h"
+#include "alloc_tracker.h"
 #include "audiofile.h"
+#include "frame_pool.h"
+#include "frame_reblocker.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "pipeline.h"
+#include "rt_checker.h"
+#include "sharded.h"
+#include "silence_bypass.h"
+#include "stages.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct FrameSettings
+{
+    int block_size = 0;                 // host block size in samples, 0 means 10ms
+    int num_threads = 0;                // 0 means one thread per channel, up to the number of cores
+    bool silence_bypass = false;        // skip ClearVoice for digital silence
+    StageProfiler* profiler = NULL;     // optional hardware counter instrumentation
+    MetricsRegistry* metrics = NULL;    // optional metrics export
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Process the file one host block at a time, the way a real-time application would.
+// Host blocks may be any size, the reblockers turn them into the 10ms buffers ClearVoice needs.
+static bool process_frames(const char* license_filepath, imm_cv_config config,
+                           std::vector<std::vector<float>>& input, std::vector<std::vector<float>>& output,
+                           int num_samples, int buffer_size, FrameSettings settings)
+{
+    int block_size = settings.block_size > 0 ? settings.block_size : buffer_size;
+    int num_threads = settings.num_threads;
+    bool silence_bypass = settings.silence_bypass;
+    int num_channels = (int)input.size();
+
+    // Initialize Immersitech ClearVoice
+    // A ClearVoice handle processes a single channel, so each channel of the file gets its own handle
+    imm_error_code error_code;
+    std::vector<imm_cv_handle> handles(num_channels);
+    std::vector<imm_cv_output_metadata> metadata(num_channels);
+    std::vector<FrameReblocker> reblockers;
+    std::vector<SilenceBypass> bypasses;
+    for (int c = 0; c < num_channels; c++) {
+        handles[c] = imm_cv_init_from_file(license_filepath, config, &error_code);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cout << "imm_cv_init_from_file failed for channel " << c << " with error code " << error_code << std::endl;
+            return false;
+        }
+        reblockers.emplace_back(buffer_size, block_size);
+        bypasses.emplace_back(buffer_size);
+    }
+
+    // Metrics are registered up front, so the workers only update them
+    MetricCounter* blocks_processed = NULL;
+    MetricCounter* block_overruns = NULL;
+    MetricHistogram* block_duration = NULL;
+    MetricHistogram* process_duration = NULL;
+    MetricGauge* active_channels = NULL;
+    std::unique_ptr<MetricErrorCounters> imm_errors;
+    if (settings.metrics != NULL) {
+        blocks_processed = settings.metrics->counter("imm_blocks_processed_total", "Host blocks processed");
+        block_overruns = settings.metrics->counter("imm_block_overruns_total", "Host blocks that took longer than their real-time period to process");
+        block_duration = settings.metrics->histogram("imm_block_duration_seconds", "Time to process one host block", MetricHistogram::latency_buckets());
+        process_duration = settings.metrics->histogram("imm_call_duration_seconds", "Duration of imm_* calls", MetricHistogram::latency_buckets(),
+                                                       metric_label("call", "imm_cv_process"));
+        active_channels = settings.metrics->gauge("imm_active_channels", "Channels being processed");
+        active_channels->set(num_channels);
+        // Codes not listed are counted as code="other"
+        imm_errors.reset(new MetricErrorCounters(*settings.metrics, "imm_errors_total", "Error codes returned by imm_* calls", "",
+                                                 { "imm_cv_process" }, { IMM_ERROR_HANDLE_NULL, IMM_ERROR_INVALID_CONFIGURATION }));
+    }
+
+    // Runs one buffer through ClearVoice, timing it and counting errors when metrics are enabled
+    auto run_clearvoice = [&](int c, const float* in, float* out) {
+        if (settings.metrics == NULL) {
+            imm_cv_process(handles[c], in, out, &metadata[c]);
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        imm_error_code code = imm_cv_process(handles[c], in, out, &metadata[c]);
+        process_duration->observe(seconds_since(start));
+        imm_errors->count("imm_cv_process", code);
+    };
+
+    // Runs one 10ms buffer of channel c through ClearVoice, unless it is digital silence
+    auto process_buffer = [&](int c, const float* in, float* out) {
+        if (silence_bypass) {
+            bypasses[c].process(in, out, [&](const float* bypass_in, float* bypass_out) {
+                run_clearvoice(c, bypass_in, bypass_out);
+            });
+        }
+        else {
+            run_clearvoice(c, in, out);
+        }
+    };
+
+    // The output is delayed by the reblocking latency, so leave room for the tail
+    int latency = reblockers[0].get_latency();
+    for (int c = 0; c < num_channels; c++) {
+        output[c].resize((size_t)num_samples + latency);
+    }
+
+    // Each worker owns every num_threads-th channel. All workers finish a block
+    // before any of them starts the next one, so the channels stay sample-aligned.
+    if (num_threads <= 0) {
+        num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, num_channels);
+
+    FramePool pool(num_threads, [&](int worker, int block) {
+        int s = block * block_size;
+        int n = std::min(block_size, num_samples - s);
+        bool steady = s >= CV_ALLOC_WARMUP_FRAMES * buffer_size;
+        for (int c = worker; c < num_channels; c += num_threads) {
+            StageScope scope(settings.profiler, CV_STAGE_PROCESS, block);
+            AllocScope alloc_scope(CV_STAGE_PROCESS, steady);
+            RtRegion rt_region(CV_STAGE_PROCESS, steady);
+            reblockers[c].process(&input[c][s], &output[c][s], n, [&](const float* in, float* out) {
+                process_buffer(c, in, out);
+            });
+        }
+    });
+
+    int num_blocks = (num_samples + block_size - 1) / block_size;
+    double block_period = (double)block_size / (buffer_size * 100);
+    for (int block = 0; block < num_blocks; block++) {
+        std::chrono::steady_clock::time_point block_start = std::chrono::steady_clock::now();
+        pool.run_frame(block);
+        if (settings.metrics != NULL) {
+            double block_seconds = seconds_since(block_start);
+            blocks_processed->add();
+            block_duration->observe(block_seconds);
+            if (block_seconds > block_period) {
+                block_overruns->add();
+            }
+        }
+    }
+
+    // Collect the delayed tail and line the output back up with the input
+    for (int c = 0; c < num_channels; c++) {
+        reblockers[c].flush(output[c].data() + num_samples, [&](const float* in, float* out) {
+            process_buffer(c, in, out);
+        });
+        output[c].erase(output[c].begin(), output[c].begin() + latency);
+    }
+    if (active_channels != NULL) {
+        active_channels->set(0);
+    }
+
+    if (silence_bypass) {
+        SilenceBypass::Stats stats;
+        for (int c = 0; c < num_channels; c++) {
+            stats += bypasses[c].get_stats();
+        }
+        SilenceBypass::print_report(stats);
+    }
+
+    return true;
+}
 
 int main(int argc, const char* argv[])
 {
     if (argc < 4)
     {
-        std::cout << "Usage: \nclearvoice_demo.exe <licensefile> <input.wav> <output.wav> " << std::endl;
+        std::cout << "Usage: \nclearvoice_demo.exe <licensefile> <input.wav> <output.wav> [--threads N] [--block N] [--shards N] [--pipeline] [--silence-bypass] [--perf-counters] [--perf-csv FILE] [--alloc-check] [--rt-check] [--metrics FILE] [--metrics-port N]" << std::endl;
+        std::cout << "  --threads N       Number of threads used to process the file" << std::endl;
+        std::cout << "  --block N         Feed the audio in blocks of N samples, like an audio callback would (default 10ms)" << std::endl;
+        std::cout << "  --silence-bypass  Skip ClearVoice for buffers of digital silence and report the CPU time saved" << std::endl;
+        std::cout << "  --shards N        Split the file into N overlapping segments processed in parallel (0 = one per thread)" << std::endl;
+        std::cout << "  --pipeline        Read, process and write on separate threads while streaming the file" << std::endl;
+        std::cout << "  --perf-counters   Measure cycles, instructions, cache and branch misses per stage and report IPC" << std::endl;
+        std::cout << "  --perf-csv FILE   Like --perf-counters, and also write the counters of every block to FILE" << std::endl;
+        std::cout << "  --alloc-check     Fail the run if anything allocates while processing, once warmed up" << std::endl;
+        std::cout << "  --rt-check        Fail the run on locks, blocking calls or page faults while processing, once warmed up" << std::endl;
+        std::cout << "  --metrics FILE    Write Prometheus metrics to FILE every second while processing blocks" << std::endl;
+        std::cout << "  --metrics-port N  Serve Prometheus metrics on http://127.0.0.1:N/metrics while processing blocks" << std::endl;
         return 1;
     }
 
@@ -15,55 +196,183 @@ int main(int argc, const char* argv[])
     const char* input_audio_file = argv[2];
     const char* output_audio_file = argv[3];
 
+    // Optional settings
+    FrameSettings frame_settings;
+    bool sharded = false;
+    ShardedSettings shard_settings;
+    bool pipelined = false;
+    PipelineSettings pipeline_settings;
+    bool perf_counters = false;
+    const char* perf_csv = NULL;
+    bool alloc_check = false;
+    bool rt_check = false;
+    const char* metrics_path = NULL;
+    int metrics_port = 0;
+    for (int a = 4; a < argc; a++) {
+        if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+            frame_settings.num_threads = shard_settings.num_threads = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--block") == 0 && a + 1 < argc) {
+            frame_settings.block_size = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--silence-bypass") == 0) {
+            frame_settings.silence_bypass = true;
+        }
+        else if (strcmp(argv[a], "--shards") == 0 && a + 1 < argc) {
+            sharded = true;
+            shard_settings.num_shards = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--pipeline") == 0) {
+            pipelined = true;
+        }
+        else if (strcmp(argv[a], "--perf-counters") == 0) {
+            perf_counters = true;
+        }
+        else if (strcmp(argv[a], "--perf-csv") == 0 && a + 1 < argc) {
+            perf_counters = true;
+            perf_csv = argv[++a];
+        }
+        else if (strcmp(argv[a], "--alloc-check") == 0) {
+            alloc_check = true;
+        }
+        else if (strcmp(argv[a], "--rt-check") == 0) {
+            rt_check = true;
+        }
+        else if (strcmp(argv[a], "--metrics") == 0 && a + 1 < argc) {
+            metrics_path = argv[++a];
+        }
+        else if (strcmp(argv[a], "--metrics-port") == 0 && a + 1 < argc) {
+            metrics_port = atoi(argv[++a]);
+        }
+        else {
+            std::cout << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+
+    if (frame_settings.block_size > 0 && (sharded || pipelined)) {
+        std::cout << "--block only applies to block by block processing" << std::endl;
+        return 1;
+    }
+    if (frame_settings.silence_bypass && (sharded || pipelined)) {
+        std::cout << "--silence-bypass only applies to block by block processing" << std::endl;
+        return 1;
+    }
+
+    // Hardware counters for the read, process and write stages
+    std::unique_ptr<StageProfiler> profiler;
+    if (perf_counters) {
+        profiler.reset(new StageProfiler(clearvoice_stage_names()));
+        frame_settings.profiler = pipeline_settings.profiler = profiler.get();
+    }
+    // Metrics of the block by block processing, exported while it runs
+    MetricsRegistry metrics;
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    if (metrics_path != NULL || metrics_port > 0) {
+        if (sharded || pipelined) {
+            std::cout << "--metrics and --metrics-port only apply to block by block processing" << std::endl;
+            return 1;
+        }
+        frame_settings.metrics = &metrics;
+        metrics_exporter.reset(new MetricsExporter(&metrics, metrics_path, metrics_port));
+    }
+    // Allocations are counted per stage, and with --alloc-check each one made after
+    // warm-up is logged with its stack and fails the run
+    register_clearvoice_alloc_scopes();
+    AllocTracker::name_thread("main");
+    AllocTracker::enable_checks(alloc_check);
+
+    // With --rt-check, locks, blocking calls and page faults while processing fail the run too
+    register_clearvoice_rt_regions();
+    RtChecker::enable_checks(rt_check);
+    auto report = [&]() {
+        if (profiler) {
+            profiler->print_report();
+            if (perf_csv != NULL) {
+                profiler->write_csv(perf_csv);
+            }
+        }
+        if (alloc_check) {
+            AllocTracker::print_report();
+        }
+        if (rt_check) {
+            RtChecker::print_report();
+        }
+        return AllocTracker::get_violations() == 0 && RtChecker::get_violations() == 0;
+    };
+
+    // The pipeline streams the file from disk instead of loading it all up front
+    if (pipelined) {
+        if (!process_pipelined(license_filepath, input_audio_file, output_audio_file, pipeline_settings)) {
+            return 1;
+        }
+        if (!report()) {
+            return 1;
+        }
+        std::cout << "Done." << std::endl;
+        return 0;
+    }
+
     // Load input file
     AudioFile<float> input_file;
-    bool loadedOK = input_file.load(input_audio_file);
+    bool loadedOK;
+    {
+        StageScope scope(profiler.get(), CV_STAGE_READ, 0);
+        loadedOK = input_file.load(input_audio_file);
+    }
     if (loadedOK == false) {
         std::cout << "Failed to load input file " << input_audio_file << std::endl;
         return 1;
     }
     int sample_rate = input_file.getSampleRate();
     int num_channels = input_file.getNumChannels();
-    if (num_channels > 1) {
-        std::cout << "Sorry, only mono files are supported with the ClearVoice library." << std::endl;
-        return 1;
-    }
     int max_samples = input_file.getNumSamplesPerChannel();
     int buffer_size = sample_rate / 100; // ClearVoice always processes using 10ms buffers
 
     // Create output file
     AudioFile<float> output_file;
-    output_file.setNumSamplesPerChannel(max_samples);
+    output_file.setAudioBufferSize(num_channels, max_samples);
     output_file.setSampleRate(sample_rate);
 
-    // Create necessary variables
-    imm_cv_config config;
-    imm_error_code error_code;
-    imm_cv_output_metadata metadata;
-    imm_cv_handle handle;
-
     // Configure Immersitech ClearVoice
-    config = imm_cv_get_default_config();
+    imm_cv_config config = imm_cv_get_default_config();
     config.input_sample_rate = sample_rate;
     config.output_sample_rate = sample_rate;
 
-    // Initialize Immersitech ClearVoice
-    handle = imm_cv_init_from_file(license_filepath, config, &error_code);
-    if (error_code != IMM_ERROR_NONE) {
-        return 1;
+    // Process the audio
+    bool processedOK;
+    if (sharded) {
+        // Long files can be cut into segments that are processed in parallel
+        // Shards work on whole 10ms buffers, so zero-pad the last one
+        int padded_samples = ((max_samples + buffer_size - 1) / buffer_size) * buffer_size;
+        input_file.setNumSamplesPerChannel(padded_samples);
+        output_file.setNumSamplesPerChannel(padded_samples);
+        processedOK = process_sharded(license_filepath, config, input_file.samples, output_file.samples, padded_samples / buffer_size, buffer_size, shard_settings);
     }
-
-    // Process audio file one buffer at a time
-    int s = 0;
-    while(s < max_samples) {
-        imm_cv_process(handle, &input_file.samples[0][s], &output_file.samples[0][s], &metadata);
-        s = s + buffer_size;
+    else {
+        processedOK = process_frames(license_filepath, config, input_file.samples, output_file.samples, max_samples, buffer_size, frame_settings);
+    }
+    metrics_exporter.reset(); // final export
+    if (processedOK == false) {
+        return 1;
     }
 
     // Write the output file
+    output_file.setNumSamplesPerChannel(max_samples);
     output_file.setBitDepth(16);
-    output_file.save(output_audio_file, AudioFileFormat::Wave);
-    
+    bool savedOK;
+    {
+        StageScope scope(profiler.get(), CV_STAGE_WRITE, 0);
+        savedOK = output_file.save(output_audio_file, AudioFileFormat::Wave);
+    }
+    if (savedOK == false) {
+        std::cout << "Failed to write " << output_audio_file << std::endl;
+        return 1;
+    }
+
+    if (!report()) {
+        return 1;
+    }
     std::cout << "Done." << std::endl;
 
     return 0;
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "immersitech_clearvoice.h"
+#include "perf_counters.h"
+#include "spsc_ring.h"
+#include "stages.h"
+#include "wav_stream.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+
+Three-stage read / process / write pipeline.
+
+    reader thread --> [input ring] --> processing thread --> [output ring] --> writer thread
+
+The reader decodes the input file 10ms at a time, the processing thread (the caller) runs
+every channel through ClearVoice, and the writer encodes the result. The rings hold a fixed
+number of pre-allocated 10ms frames; when one fills up the stage in front of it waits, so a
+slow disk only stalls processing once the rings have run dry.
+
+*/
+struct PipelineSettings
+{
+    int ring_frames = 64;               // 640ms of audio between each pair of stages
+    StageProfiler* profiler = NULL;     // optional hardware counter instrumentation
+};
+
+inline bool process_pipelined(const char* license_filepath, const char* input_path, const char* output_path, PipelineSettings settings)
+{
+    WavReader reader;
+    if (!reader.open(input_path)) {
+        return false;
+    }
+    int sample_rate = reader.get_sample_rate();
+    int num_channels = reader.get_num_channels();
+    int buffer_size = sample_rate / 100; // ClearVoice always processes using 10ms buffers
+
+    WavWriter writer;
+    if (!writer.open(output_path, sample_rate, num_channels, 16)) {
+        return false;
+    }
+
+    imm_cv_config config = imm_cv_get_default_config();
+    config.input_sample_rate = sample_rate;
+    config.output_sample_rate = sample_rate;
+
+    // A ClearVoice handle processes a single channel, so each channel of the file gets its own handle
+    std::vector<imm_cv_handle> handles(num_channels);
+    for (int c = 0; c < num_channels; c++) {
+        imm_error_code error_code;
+        handles[c] = imm_cv_init_from_file(license_filepath, config, &error_code);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cout << "imm_cv_init_from_file failed for channel " << c << " with error code " << error_code << std::endl;
+            return false;
+        }
+    }
+
+    // Each slot is one 10ms frame, stored channel after channel
+    int slot_size = num_channels * buffer_size;
+    SpscRing input_ring(settings.ring_frames, slot_size);
+    SpscRing output_ring(settings.ring_frames, slot_size);
+    reader.reserve(buffer_size);
+    writer.reserve(buffer_size);
+
+    std::thread reader_thread([&]() {
+        AllocTracker::name_thread("reader");
+        long long index = 0;
+        bool last = false;
+        while (!last) {
+            SpscRing::Slot* slot = input_ring.acquire_write();
+            int frames;
+            {
+                StageScope scope(settings.profiler, CV_STAGE_READ, index);
+                AllocScope alloc_scope(CV_STAGE_READ, index >= CV_ALLOC_WARMUP_FRAMES);
+                frames = reader.read(slot->data, buffer_size, buffer_size);
+            }
+            last = reader.get_frames_left() == 0 || frames < buffer_size;
+
+            // Zero-pad the final partial frame, the writer trims it again
+            for (int c = 0; c < num_channels && frames < buffer_size; c++) {
+                std::fill(slot->data + c * buffer_size + frames, slot->data + (c + 1) * buffer_size, 0.0f);
+            }
+            slot->frames = frames;
+            slot->index = index++;
+            slot->last = last;
+            input_ring.publish();
+        }
+    });
+
+    std::atomic<bool> write_failed(false);
+    std::thread writer_thread([&]() {
+        AllocTracker::name_thread("writer");
+        bool last = false;
+        while (!last) {
+            SpscRing::Slot* slot = output_ring.acquire_read();
+            if (slot->frames > 0) {
+                StageScope scope(settings.profiler, CV_STAGE_WRITE, slot->index);
+                AllocScope alloc_scope(CV_STAGE_WRITE, slot->index >= CV_ALLOC_WARMUP_FRAMES);
+                if (!writer.write(slot->data, slot->frames, buffer_size)) {
+                    write_failed = true;
+                }
+            }
+            last = slot->last;
+            output_ring.release();
+        }
+    });
+
+    imm_cv_output_metadata metadata;
+    bool last = false;
+    while (!last) {
+        SpscRing::Slot* in = input_ring.acquire_read();
+        SpscRing::Slot* out = output_ring.acquire_write();
+        {
+            StageScope scope(settings.profiler, CV_STAGE_PROCESS, in->index);
+            AllocScope alloc_scope(CV_STAGE_PROCESS, in->index >= CV_ALLOC_WARMUP_FRAMES);
+            RtRegion rt_region(CV_STAGE_PROCESS, in->index >= CV_ALLOC_WARMUP_FRAMES);
+            for (int c = 0; c < num_channels; c++) {
+                imm_cv_process(handles[c], in->data + c * buffer_size, out->data + c * buffer_size, &metadata);
+            }
+        }
+        out->frames = in->frames;
+        out->index = in->index;
+        out->last = last = in->last;
+        input_ring.release();
+        output_ring.publish();
+    }
+
+    reader_thread.join();
+    writer_thread.join();
+    bool closedOK = writer.close();
+    if (reader.has_failed()) {
+        std::cout << "Failed to read " << input_path << std::endl;
+        return false;
+    }
+
+    // If processing is the bottleneck the reader waits on a full input ring and the writer
+    // waits on an empty output ring, while the processing thread itself hardly ever waits.
+    std::cout << "Reader waited " << input_ring.get_producer_waits() << " times on a full input ring" << std::endl;
+    std::cout << "Processing waited " << input_ring.get_consumer_waits() << " times for input and "
+              << output_ring.get_producer_waits() << " times for the writer" << std::endl;
+
+    if (write_failed || !closedOK) {
+        std::cout << "Failed to write " << output_path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "immersitech_clearvoice.h"
+#include "stages.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+
+Sharded processing of a single long recording.
+
+The file is cut into num_shards segments on 10ms frame boundaries and every segment of
+every channel is processed by its own ClearVoice handle, so one file can use every core.
+
+A segment's handle first runs over the warm-up region just before the segment (its output
+is thrown away) so the denoiser has adapted by the time the segment starts. Each segment
+also keeps processing for crossfade_frames past its end, and that tail is crossfaded with
+the start of the next segment to hide any remaining difference between the two handles.
+
+    segment k-1   ...=========\
+    segment k         [warm-up]/===========\
+                                 crossfade
+
+*/
+struct ShardedSettings
+{
+    int num_shards = 0;         // 0 means one shard per thread
+    int num_threads = 0;        // 0 means one thread per core
+    int warmup_frames = 100;    // 1 second of warm-up before every shard but the first
+    int crossfade_frames = 2;   // 20ms crossfade between neighbouring shards
+};
+
+inline bool process_sharded(const char* license_filepath, imm_cv_config config,
+                            std::vector<std::vector<float>>& input, std::vector<std::vector<float>>& output,
+                            int num_frames, int buffer_size, ShardedSettings settings)
+{
+    int num_channels = (int)input.size();
+    int num_threads = settings.num_threads;
+    if (num_threads <= 0) {
+        num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    int num_shards = settings.num_shards > 0 ? settings.num_shards : num_threads;
+    int fade = std::max(0, settings.crossfade_frames);
+
+    // Every shard must be at least as long as the crossfade so neighbouring crossfades do not overlap
+    num_shards = std::max(1, std::min(num_shards, num_frames / std::max(1, fade)));
+
+    std::vector<int> bounds(num_shards + 1);
+    for (int k = 0; k <= num_shards; k++) {
+        bounds[k] = (int)(((long long)k * num_frames) / num_shards);
+    }
+
+    // One handle per (channel, shard) job. Handles are created up front on this thread.
+    int num_jobs = num_channels * num_shards;
+    std::vector<imm_cv_handle> handles(num_jobs);
+    for (int j = 0; j < num_jobs; j++) {
+        imm_error_code error_code;
+        handles[j] = imm_cv_init_from_file(license_filepath, config, &error_code);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cout << "imm_cv_init_from_file failed for shard " << j % num_shards << " of channel " << j / num_shards << " with error code " << error_code << std::endl;
+            return false;
+        }
+    }
+
+    // The first crossfade_frames of every shard but the first are kept aside, the rest goes
+    // straight into the output. Shards therefore never write to the same samples.
+    std::vector<std::vector<float>> heads(num_jobs, std::vector<float>((size_t)fade * buffer_size));
+
+    std::atomic<int> next_job(0);
+    auto worker = [&]() {
+        imm_cv_output_metadata metadata;
+        std::vector<float> discard(buffer_size);    // warm-up output, one per thread
+        for (int j = next_job++; j < num_jobs; j = next_job++) {
+            int c = j / num_shards;
+            int k = j % num_shards;
+            int first = bounds[k];
+            int last = std::min(bounds[k + 1] + fade, num_frames);
+
+            // Warm up on the audio that precedes this shard
+            int start = std::max(0, first - settings.warmup_frames);
+            for (int f = start; f < first; f++) {
+                AllocScope alloc_scope(CV_STAGE_PROCESS, f - start >= CV_ALLOC_WARMUP_FRAMES);
+                RtRegion rt_region(CV_STAGE_PROCESS, f - start >= CV_ALLOC_WARMUP_FRAMES);
+                imm_cv_process(handles[j], &input[c][(size_t)f * buffer_size], discard.data(), &metadata);
+            }
+
+            for (int f = first; f < last; f++) {
+                size_t s = (size_t)f * buffer_size;
+                float* out = &output[c][s];
+                if (k > 0 && f < first + fade) {
+                    out = &heads[j][(size_t)(f - first) * buffer_size];
+                }
+                AllocScope alloc_scope(CV_STAGE_PROCESS, f - start >= CV_ALLOC_WARMUP_FRAMES);
+                RtRegion rt_region(CV_STAGE_PROCESS, f - start >= CV_ALLOC_WARMUP_FRAMES);
+                imm_cv_process(handles[j], &input[c][s], out, &metadata);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < std::min(num_threads, num_jobs); t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // Stitch: fade out the tail of shard k-1 while fading in the head of shard k
+    int fade_samples = fade * buffer_size;
+    for (int c = 0; c < num_channels; c++) {
+        for (int k = 1; k < num_shards; k++) {
+            float* out = &output[c][(size_t)bounds[k] * buffer_size];
+            const float* head = heads[c * num_shards + k].data();
+            for (int i = 0; i < fade_samples; i++) {
+                float gain = (i + 0.5f) / fade_samples;
+                out[i] = (1.0f - gain) * out[i] + gain * head[i];
+            }
+        }
+    }
+
+    return true;
+}
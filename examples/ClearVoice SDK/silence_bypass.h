@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMM_SILENCE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMM_SILENCE_NEON 1
+#endif
+
+// True when every sample is exactly +0.0f or -0.0f, as produced by a muted call leg
+inline bool is_digital_silence(const float* samples, int num_samples)
+{
+    int i = 0;
+#if defined(IMM_SILENCE_SSE2)
+    const __m128i magnitude = _mm_set1_epi32(0x7fffffff);
+    for (; i + 16 <= num_samples; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(samples + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i*)(samples + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i*)(samples + i + 12));
+        __m128i bits = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), magnitude);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    }
+#elif defined(IMM_SILENCE_NEON)
+    const uint32x4_t magnitude = vdupq_n_u32(0x7fffffff);
+    for (; i + 16 <= num_samples; i += 16) {
+        uint32x4_t a = vreinterpretq_u32_f32(vld1q_f32(samples + i));
+        uint32x4_t b = vreinterpretq_u32_f32(vld1q_f32(samples + i + 4));
+        uint32x4_t c = vreinterpretq_u32_f32(vld1q_f32(samples + i + 8));
+        uint32x4_t d = vreinterpretq_u32_f32(vld1q_f32(samples + i + 12));
+        uint32x4_t bits = vandq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d)), magnitude);
+        uint32x2_t folded = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+        if ((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0) {
+            return false;
+        }
+    }
+#endif
+    for (; i < num_samples; i++) {
+        uint32_t bits;
+        memcpy(&bits, &samples[i], sizeof(bits));
+        if ((bits & 0x7fffffff) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+
+Skips ClearVoice for frames of digital silence.
+
+A run of all-zero frames is still processed for the first warmup_frames frames, so any audio
+ClearVoice is still holding on to is let out, and is then replaced by silence without calling
+the processor. Before the first frame with signal the processor is fed warmup_frames frames of
+silence again (their output is discarded), so its state is the same as if it had processed the
+whole silent run.
+
+*/
+class SilenceBypass
+{
+public:
+    struct Stats
+    {
+        long long frames = 0;             // frames handed to the bypass
+        long long bypassed_frames = 0;    // frames that never reached the processor
+        long long warmup_frames = 0;      // extra frames processed to warm the processor back up
+        long long processed_frames = 0;   // every call into the processor, warm-up included
+        double process_seconds = 0;       // time spent inside the processor
+
+        Stats& operator+=(const Stats& other)
+        {
+            frames += other.frames;
+            bypassed_frames += other.bypassed_frames;
+            warmup_frames += other.warmup_frames;
+            processed_frames += other.processed_frames;
+            process_seconds += other.process_seconds;
+            return *this;
+        }
+    };
+
+    // Estimate the processing time saved, assuming a bypassed frame would have cost as much as a processed one
+    static void print_report(const Stats& stats)
+    {
+        double seconds_per_frame = stats.processed_frames > 0 ? stats.process_seconds / stats.processed_frames : 0.0;
+        double saved_seconds = (stats.bypassed_frames - stats.warmup_frames) * seconds_per_frame;
+        double full_seconds = stats.frames * seconds_per_frame;
+        std::cout << "Silence bypass skipped " << stats.bypassed_frames << " of " << stats.frames << " frames ("
+                  << (stats.frames > 0 ? 100.0 * stats.bypassed_frames / stats.frames : 0.0) << "%) and replayed "
+                  << stats.warmup_frames << " frames to warm back up" << std::endl;
+        std::cout << "ClearVoice ran for " << stats.process_seconds << " s instead of about " << full_seconds
+                  << " s, saving " << (full_seconds > 0 ? 100.0 * saved_seconds / full_seconds : 0.0) << "% of its CPU time" << std::endl;
+    }
+
+    SilenceBypass(int frame_size, int warmup_frames = 3)
+        : frame_size(frame_size), warmup_frames(warmup_frames), silence(frame_size, 0.0f), discard(frame_size)
+    {
+    }
+
+    template <class Process>
+    void process(const float* in, float* out, Process&& process_frame)
+    {
+        stats.frames++;
+
+        if (is_digital_silence(in, frame_size)) {
+            silent_run++;
+            if (silent_run > warmup_frames) {
+                memset(out, 0, frame_size * sizeof(float));
+                stats.bypassed_frames++;
+                return;
+            }
+        }
+        else {
+            if (silent_run > warmup_frames) {
+                // Replay the end of the silent run so the processor catches up
+                long long skipped = silent_run - warmup_frames;
+                for (long long f = 0; f < warmup_frames && f < skipped; f++) {
+                    timed_process(silence.data(), discard.data(), process_frame);
+                    stats.warmup_frames++;
+                }
+            }
+            silent_run = 0;
+        }
+
+        timed_process(in, out, process_frame);
+    }
+
+    const Stats& get_stats() const { return stats; }
+
+private:
+    template <class Process>
+    void timed_process(const float* in, float* out, Process& process_frame)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        process_frame(in, out);
+        stats.process_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.processed_frames++;
+    }
+
+    int frame_size;
+    int warmup_frames;
+    long long silent_run = 0;
+    std::vector<float> silence;
+    std::vector<float> discard;
+    Stats stats;
+};
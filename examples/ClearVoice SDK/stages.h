@@ -0,0 +1,40 @@
+#pragma once
+
+#include "alloc_tracker.h"
+#include "rt_checker.h"
+
+#include <string>
+#include <vector>
+
+// Stages of the ClearVoice demo that can be measured with a StageProfiler
+// and checked with an AllocScope or RtRegion
+enum ClearVoiceStage
+{
+    CV_STAGE_READ = 0,
+    CV_STAGE_PROCESS,
+    CV_STAGE_WRITE
+};
+
+// 10ms buffers a ClearVoice handle may allocate or block in before that counts as a violation
+static const int CV_ALLOC_WARMUP_FRAMES = 10;
+
+inline std::vector<std::string> clearvoice_stage_names()
+{
+    return { "read", "imm_cv_process", "write" };
+}
+
+// Registers the stages as allocation scopes, in order, so their scope ids match ClearVoiceStage
+inline void register_clearvoice_alloc_scopes()
+{
+    AllocTracker::register_scope("read");
+    AllocTracker::register_scope("imm_cv_process");
+    AllocTracker::register_scope("write");
+}
+
+// Registers the stages as real-time regions, in order, so their region ids match ClearVoiceStage
+inline void register_clearvoice_rt_regions()
+{
+    RtChecker::register_region("read");
+    RtChecker::register_region("imm_cv_process");
+    RtChecker::register_region("write");
+}
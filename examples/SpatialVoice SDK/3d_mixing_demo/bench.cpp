@@ -0,0 +1,264 @@
+#include "immersitech.h"
+#include "talkers.h"
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE (48000)
+#define OUTPUT_NUM_FRAMES (480)
+
+/*
+
+This command line tool measures how fast the 3D mixing runs for rooms of different sizes and at
+different spatial_quality levels.
+
+For every spatial_quality and participant count, a library instance is created with one room.
+Every participant talks, using the bundled audio files looped and offset from each other, and
+is placed on a circle around the center of the room. A number of warm-up blocks are mixed, then
+a fixed number of timed blocks, on a thread pinned to one CPU. A block is one
+imm_input_audio_float and one imm_output_audio_float call per participant. The results are
+printed to stdout as JSON so they can be stored and compared.
+
+The ladder at the end of the output compares the spatial_quality levels: the cost per
+participant in the largest room measured, each level's cost relative to the highest level
+measured, and how many participants one room can have before a block takes longer than its 10ms
+on one core. Every listener hears every talker, so that capacity is interpolated between the
+measured room sizes around it. When even the largest room fits, it is extended from the two
+largest sizes and marked as extrapolated, which overestimates it; measure bigger rooms to pin it
+down.
+
+SYNTAX:
+3d_mixing_bench <licensefile> [--participants N] ... [--quality N] ... [--blocks N] [--warmup N] [--audio-dir DIR] [--cpu N]
+
+*/
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: \n3d_mixing_bench <licensefile> [--participants N] ... [--quality N] ... [--blocks N] [--warmup N] [--audio-dir DIR] [--cpu N]" << std::endl;
+        std::cerr << "  --participants N  Participants in the room, may be repeated (default 2 8 32)" << std::endl;
+        std::cerr << "  --quality N       spatial_quality from 1 to 5, may be repeated (default 1 2 3 4 5)" << std::endl;
+        std::cerr << "  --blocks N        Timed 10ms blocks per configuration (default 1000)" << std::endl;
+        std::cerr << "  --warmup N        Untimed 10ms blocks before timing starts (default 50)" << std::endl;
+        std::cerr << "  --audio-dir DIR   Folder with the mono WAV files the participants say (default: the bundled audio_files)" << std::endl;
+        std::cerr << "  --cpu N           CPU to pin the benchmark thread to, -1 to not pin (default 0)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    std::vector<int> participant_counts;
+    std::vector<int> qualities;
+    int timed_blocks = 1000;
+    int warmup_blocks = 50;
+    std::string audio_dir = IMM_AUDIO_FILES_DIR;
+    int cpu = 0;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--participants") == 0 && a + 1 < argc) {
+            participant_counts.push_back(std::max(1, atoi(argv[++a])));
+        }
+        else if (strcmp(argv[a], "--quality") == 0 && a + 1 < argc) {
+            qualities.push_back(atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--blocks") == 0 && a + 1 < argc) {
+            timed_blocks = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--warmup") == 0 && a + 1 < argc) {
+            warmup_blocks = std::max(0, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--audio-dir") == 0 && a + 1 < argc) {
+            audio_dir = argv[++a];
+        }
+        else if (strcmp(argv[a], "--cpu") == 0 && a + 1 < argc) {
+            cpu = atoi(argv[++a]);
+        }
+        else {
+            std::cerr << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+    if (participant_counts.empty()) {
+        participant_counts = { 2, 8, 32 };
+    }
+    if (qualities.empty()) {
+        qualities = { 1, 2, 3, 4, 5 };
+    }
+
+    TalkerAudio talkers;
+    if (!talkers.load(audio_dir, OUTPUT_NUM_FRAMES, OUTPUT_SAMPLE_RATE)) {
+        return 1;
+    }
+    int input_rate = talkers.get_sample_rate();
+    int input_frames = talkers.get_block_frames();
+
+    bool pinned = pin_current_thread(cpu);
+    if (cpu >= 0 && !pinned) {
+        std::cerr << "Could not pin the benchmark thread to CPU " << cpu << ", results may be noisier" << std::endl;
+    }
+
+    std::cout << "{\n  \"benchmark\": \"3d_mixing\",\n  \"timed_blocks\": " << timed_blocks
+              << ",\n  \"warmup_blocks\": " << warmup_blocks
+              << ",\n  \"output_frames\": " << OUTPUT_NUM_FRAMES
+              << ",\n  \"output_sample_rate\": " << OUTPUT_SAMPLE_RATE
+              << ",\n  \"input_sample_rate\": " << input_rate
+              << ",\n  \"cpu\": " << (pinned ? cpu : -1)
+              << ",\n  \"results\": [";
+
+    bool first_result = true;
+    std::vector<float> output_buffer(2 * OUTPUT_NUM_FRAMES);
+    std::vector<std::vector<double>> mean_ns_per_quality(qualities.size());
+    for (size_t q = 0; q < qualities.size(); q++) {
+        int quality = qualities[q];
+        for (int num_participants : participant_counts) {
+            imm_library_configuration config;
+            config.interleaved = false;
+            config.output_number_channels = 2;
+            config.output_number_frames = OUTPUT_NUM_FRAMES;
+            config.output_sampling_rate = OUTPUT_SAMPLE_RATE;
+            config.spatial_quality = quality;
+            imm_error_code error_code;
+            imm_handle imm_instance = imm_initialize_library(license_filepath, NULL, NULL, config, &error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                std::cerr << "imm_initialize_library failed at spatial_quality " << quality << " with error code " << error_code << std::endl;
+                return 1;
+            }
+
+            int room_id = 0;
+            imm_create_room(imm_instance, room_id);
+            imm_participant_configuration participant_config;
+            participant_config.input_number_channels = 1;
+            participant_config.input_sampling_rate = input_rate;
+            participant_config.type = IMM_PARTICIPANT_REGULAR;
+            for (int p = 0; p < num_participants; p++) {
+                error_code = imm_add_participant(imm_instance, room_id, p, "participant", participant_config);
+                if (error_code != IMM_ERROR_NONE) {
+                    std::cerr << "imm_add_participant failed with error code " << error_code << std::endl;
+                    return 1;
+                }
+            }
+            imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
+            imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_MAX_DISTANCE, 300);
+
+            seat_on_circle(imm_instance, room_id, 0, num_participants);
+
+            auto mix_block = [&](int block) {
+                for (int p = 0; p < num_participants; p++) {
+                    imm_input_audio_float(imm_instance, room_id, p, talkers.block(p, block), input_frames);
+                }
+                for (int p = 0; p < num_participants; p++) {
+                    imm_output_audio_float(imm_instance, room_id, p, output_buffer.data());
+                }
+            };
+
+            for (int b = 0; b < warmup_blocks; b++) {
+                mix_block(b);
+            }
+            std::vector<double> block_ns(timed_blocks);
+            std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+            for (int b = 0; b < timed_blocks; b++) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                mix_block(warmup_blocks + b);
+                block_ns[b] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+            for (int p = 0; p < num_participants; p++) {
+                imm_remove_participant(imm_instance, room_id, p);
+            }
+            imm_destroy_room(imm_instance, room_id);
+            imm_destroy_library(imm_instance);
+
+            std::sort(block_ns.begin(), block_ns.end());
+            double mean_ns = 0;
+            for (double ns : block_ns) {
+                mean_ns += ns;
+            }
+            mean_ns /= timed_blocks;
+            mean_ns_per_quality[q].push_back(mean_ns);
+            double audio_seconds = (double)timed_blocks * OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+
+            std::cout << (first_result ? "\n" : ",\n")
+                      << "    { \"spatial_quality\": " << quality
+                      << ", \"participants\": " << num_participants
+                      << ", \"seconds\": " << seconds
+                      << ", \"real_time_factor\": " << seconds / audio_seconds
+                      << ", \"ns_per_block_mean\": " << mean_ns
+                      << ", \"ns_per_block_p50\": " << block_ns[timed_blocks / 2]
+                      << ", \"ns_per_block_p99\": " << block_ns[std::min(timed_blocks - 1, (int)(timed_blocks * 0.99))]
+                      << ", \"ns_per_block_max\": " << block_ns[timed_blocks - 1]
+                      << ", \"ns_per_participant_mean\": " << mean_ns / num_participants << " }";
+            first_result = false;
+        }
+    }
+    std::cout << "\n  ],\n  \"ladder\": [";
+
+    /* Every listener hears every talker, so the cost grows faster than the room. The capacity is
+       read off the measured room sizes instead of assuming a cost per participant. */
+    const double block_ns = 1e9 * OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+    std::vector<size_t> by_size(participant_counts.size());
+    for (size_t c = 0; c < by_size.size(); c++) {
+        by_size[c] = c;
+    }
+    std::sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) { return participant_counts[a] < participant_counts[b]; });
+    size_t top = 0;
+    for (size_t q = 0; q < qualities.size(); q++) {
+        if (qualities[q] > qualities[top]) {
+            top = q;
+        }
+    }
+    double top_total_ns = 0;
+    for (double ns : mean_ns_per_quality[top]) {
+        top_total_ns += ns;
+    }
+    for (size_t q = 0; q < qualities.size(); q++) {
+        // Interpolate between the two sizes around the block period, or extend the last two
+        double previous_n = 0, previous_ns = 0;
+        double capacity = -1;
+        for (size_t c : by_size) {
+            double n = participant_counts[c];
+            double ns = mean_ns_per_quality[q][c];
+            if (ns >= block_ns && n > previous_n) {
+                capacity = previous_n + (n - previous_n) * (block_ns - previous_ns) / (ns - previous_ns);
+                break;
+            }
+            if (n > previous_n || by_size.size() == 1) {
+                previous_n = n;
+                previous_ns = ns;
+            }
+        }
+        bool extrapolated = capacity < 0;
+        if (extrapolated) {
+            size_t last = by_size.back();
+            double n = participant_counts[last];
+            double ns = mean_ns_per_quality[q][last];
+            double before_n = 0, before_ns = 0;
+            if (by_size.size() > 1) {
+                before_n = participant_counts[by_size[by_size.size() - 2]];
+                before_ns = mean_ns_per_quality[q][by_size[by_size.size() - 2]];
+            }
+            double slope = n > before_n ? (ns - before_ns) / (n - before_n) : ns / n;
+            capacity = slope > 0 ? n + (block_ns - ns) / slope : 0;
+        }
+        double total_ns = 0;
+        for (double ns : mean_ns_per_quality[q]) {
+            total_ns += ns;
+        }
+        size_t largest = by_size.back();
+        std::cout << (q == 0 ? "\n" : ",\n")
+                  << "    { \"spatial_quality\": " << qualities[q]
+                  << ", \"ns_per_participant\": " << mean_ns_per_quality[q][largest] / participant_counts[largest]
+                  << ", \"at_participants\": " << participant_counts[largest]
+                  << ", \"participants_per_core\": " << (long long)std::max(0.0, capacity)
+                  << ", \"extrapolated\": " << (extrapolated ? "true" : "false")
+                  << ", \"relative_cost\": " << (top_total_ns > 0 ? total_ns / top_total_ns : 0) << " }";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "immersitech.h"
+
+#include "latency_probe.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/*
+
+This command line tool measures how many samples of delay the 3D mixing adds between one
+participant speaking and another participant hearing it.
+
+For every output sample rate and output_number_frames configuration, a library instance is
+created with a room holding two participants. The speaker inputs a probe signal and the listener
+inputs silence. The listener's output, left and right summed, is cross-correlated with the probe
+and the delay is printed in output samples and in milliseconds. Both participants stay at their
+default position, so the source is centered and both ears hear it at the same time.
+
+Configurations where output_number_frames does not convert to a whole number of input frames
+are skipped. Configurations the library rejects are reported as failed, and the sweep goes on.
+
+SYNTAX:
+3d_mixing_latency <licensefile> [--signal chirp|impulse] [--rate N] ... [--frames N] ... [--input-rate N]
+
+*/
+
+struct LatencyConfig
+{
+    int output_rate;
+    int output_frames;
+    int input_rate;
+};
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n3d_mixing_latency <licensefile> [--signal chirp|impulse] [--rate N] ... [--frames N] ... [--input-rate N]" << std::endl;
+        std::cout << "  --signal S       Probe signal, chirp (default) or impulse" << std::endl;
+        std::cout << "  --rate N         Output sample rate to measure, may be repeated (default 8000 16000 24000 32000 48000)" << std::endl;
+        std::cout << "  --frames N       output_number_frames to measure, may be repeated (default 128 240 256 480 512 960)" << std::endl;
+        std::cout << "  --input-rate N   Sample rate of the speaker's input (default: the output sample rate)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    ProbeSignal signal = PROBE_CHIRP;
+    std::vector<int> rates;
+    std::vector<int> frames;
+    int input_rate = 0;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--signal") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "impulse") == 0) {
+                signal = PROBE_IMPULSE;
+            }
+            else if (strcmp(argv[a], "chirp") != 0) {
+                std::cout << "Unknown signal " << argv[a] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--rate") == 0 && a + 1 < argc) {
+            rates.push_back(atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+            frames.push_back(atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--input-rate") == 0 && a + 1 < argc) {
+            input_rate = atoi(argv[++a]);
+        }
+        else {
+            std::cout << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+    if (rates.empty()) {
+        rates = { 8000, 16000, 24000, 32000, 48000 };
+    }
+    if (frames.empty()) {
+        frames = { 128, 240, 256, 480, 512, 960 };
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "%12s %10s %12s %16s %12s %12s",
+             "output rate", "frames", "input rate", "delay (samples)", "delay (ms)", "correlation");
+    std::cout << line << std::endl;
+
+    for (int output_rate : rates) {
+        for (int output_frames : frames) {
+            LatencyConfig test = { output_rate, output_frames, input_rate > 0 ? input_rate : output_rate };
+            if (test.output_rate <= 0 || test.output_frames <= 0 || test.input_rate <= 0
+                || ((long long)test.output_frames * test.input_rate) % test.output_rate != 0) {
+                snprintf(line, sizeof(line), "%12d %10d %12d %16s", test.output_rate, test.output_frames, test.input_rate, "skipped");
+                std::cout << line << std::endl;
+                continue;
+            }
+            int input_frames = (int)(((long long)test.output_frames * test.input_rate) / test.output_rate);
+
+            /* Initialize a library instance for this configuration */
+            imm_library_configuration config;
+            config.interleaved = false;
+            config.output_number_channels = 2;
+            config.output_number_frames = test.output_frames;
+            config.output_sampling_rate = test.output_rate;
+            config.spatial_quality = 3;
+            imm_error_code error_code;
+            imm_handle imm_instance = imm_initialize_library(license_filepath, NULL, NULL, config, &error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                /* The library does not support every rate, report it and go on with the next one */
+                snprintf(line, sizeof(line), "%12d %10d %12d %16s", test.output_rate, test.output_frames, test.input_rate, "failed");
+                std::cout << line << " (imm_initialize_library error code " << error_code << ")" << std::endl;
+                continue;
+            }
+
+            /* A room with a speaker (0) and a listener (1) */
+            int room_id = 0;
+            imm_create_room(imm_instance, room_id);
+            imm_participant_configuration participant_config;
+            participant_config.input_number_channels = 1;
+            participant_config.input_sampling_rate = test.input_rate;
+            participant_config.type = IMM_PARTICIPANT_REGULAR;
+            int num_added = 0;
+            while (num_added < 2) {
+                error_code = imm_add_participant(imm_instance, room_id, num_added, "participant", participant_config);
+                if (error_code != IMM_ERROR_NONE) {
+                    break;
+                }
+                num_added++;
+            }
+            if (error_code != IMM_ERROR_NONE) {
+                snprintf(line, sizeof(line), "%12d %10d %12d %16s", test.output_rate, test.output_frames, test.input_rate, "failed");
+                std::cout << line << " (imm_add_participant error code " << error_code << ")" << std::endl;
+                for (int p = 0; p < num_added; p++) {
+                    imm_remove_participant(imm_instance, room_id, p);
+                }
+                imm_destroy_room(imm_instance, room_id);
+                imm_destroy_library(imm_instance);
+                continue;
+            }
+            imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
+
+            /* The same chirp at the input and output rates, so they can be compared directly */
+            double max_frequency = 0.45 * std::min(test.input_rate, test.output_rate);
+            std::vector<float> probe = make_latency_probe(signal, test.input_rate, max_frequency);
+            std::vector<float> reference = make_latency_probe(signal, test.output_rate, max_frequency);
+            int num_blocks = ((int)probe.size() + input_frames - 1) / input_frames;
+            probe.resize((size_t)num_blocks * input_frames, 0.0f);
+
+            std::vector<float> silence(input_frames, 0.0f);
+            std::vector<float> output_buffer(2 * test.output_frames);
+            std::vector<float> heard((size_t)num_blocks * test.output_frames);
+            for (int b = 0; b < num_blocks; b++) {
+                imm_input_audio_float(imm_instance, room_id, 0, &probe[(size_t)b * input_frames], input_frames);
+                imm_input_audio_float(imm_instance, room_id, 1, silence.data(), input_frames);
+                error_code = imm_output_audio_float(imm_instance, room_id, 1, output_buffer.data());
+                if (error_code != IMM_ERROR_NONE) {
+                    break;
+                }
+                for (int i = 0; i < test.output_frames; i++) {
+                    heard[(size_t)b * test.output_frames + i] = 0.5f * (output_buffer[i] + output_buffer[test.output_frames + i]);
+                }
+            }
+
+            if (error_code != IMM_ERROR_NONE) {
+                snprintf(line, sizeof(line), "%12d %10d %12d %16s", test.output_rate, test.output_frames, test.input_rate, "failed");
+                std::cout << line << " (imm_output_audio_float error code " << error_code << ")" << std::endl;
+            }
+            else {
+                DelayEstimate estimate = estimate_delay(reference, heard, test.output_rate / 2);
+                snprintf(line, sizeof(line), "%12d %10d %12d %16d %12.2f %12.3f",
+                         test.output_rate, test.output_frames, test.input_rate, estimate.samples,
+                         estimate.samples * 1000.0 / test.output_rate, estimate.correlation);
+                std::cout << line << std::endl;
+            }
+
+            imm_remove_participant(imm_instance, room_id, 0);
+            imm_remove_participant(imm_instance, room_id, 1);
+            imm_destroy_room(imm_instance, room_id);
+            imm_destroy_library(imm_instance);
+        }
+    }
+    std::cout << "A correlation well below 1 means the output no longer resembles the probe, and its delay is not reliable." << std::endl;
+
+    return 0;
+}
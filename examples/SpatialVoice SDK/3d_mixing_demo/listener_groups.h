@@ -0,0 +1,145 @@
+#pragma once
+
+#include "immersitech.h"
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+/*
+
+Renders one mix for every group of listeners that hear exactly the same thing.
+
+A listener-only participant (IMM_PARTICIPANT_LISTENER_ONLY) adds no audio to the room, so what it
+hears depends only on where it is, which way it faces and its control states. A webinar audience
+seated on one spot all hear the same mix, yet each of them costs a whole imm_output_audio_float.
+ListenerGroups places the listeners and groups the ones with the same perspective. Every block,
+it renders the first member of each group and hands every member a pointer to that one buffer:
+
+    ListenerGroups audience(imm_instance, room_id, config.output_number_channels * config.output_number_frames);
+    audience.place(participant_id, position, heading);
+    ...
+    audience.render();
+    const float* output = audience.output(participant_id);     // shared, do not modify
+
+The library only knows each listener's control states through the imm_set_participant_state
+calls the host made, so the host describes them with state_key: listeners whose controls differ
+must be placed with different keys. Placing and removing listeners allocates, render() does not.
+
+Only the first member of a group is rendered, so the library's per-listener state, like the
+tail of a reverb, is only kept up to date for it. When it leaves, or a listener moves into a
+group of its own, the next block of the newly rendered listener can start from stale state.
+
+*/
+
+class ListenerGroups
+{
+public:
+    ListenerGroups(imm_handle imm_instance, int room_id, int block_size)
+        : imm_instance(imm_instance), room_id(room_id), block_size(block_size)
+    {
+    }
+
+    // Moves a listener, adding it when it is new, and regroups it. Returns the error code of
+    // imm_set_participant_position.
+    imm_error_code place(int participant_id, imm_position position, imm_heading heading, long long state_key = 0)
+    {
+        imm_error_code error_code = imm_set_participant_position(imm_instance, room_id, participant_id, position, heading);
+        Perspective perspective(position.x, position.y, position.z, heading.azimuth_heading, heading.elevation_heading, state_key);
+        auto listener = listeners.find(participant_id);
+        if (listener != listeners.end()) {
+            if (listener->second == perspective) {
+                return error_code;
+            }
+            leave_group(participant_id, listener->second);
+            listener->second = perspective;
+        }
+        else {
+            listeners.emplace(participant_id, perspective);
+        }
+        Group& group = groups[perspective];
+        if (group.buffer.empty()) {
+            group.buffer.assign(block_size, 0.0f);
+        }
+        group.members.push_back(participant_id);
+        return error_code;
+    }
+
+    // Forgets a listener, before it is removed from the room
+    void remove(int participant_id)
+    {
+        auto listener = listeners.find(participant_id);
+        if (listener != listeners.end()) {
+            leave_group(participant_id, listener->second);
+            listeners.erase(listener);
+        }
+    }
+
+    // Renders the mix of every group into its buffer, with one imm_output_audio_float call per
+    // group. Returns the first error code other than IMM_ERROR_NONE, and counts the calls made.
+    imm_error_code render()
+    {
+        imm_error_code result = IMM_ERROR_NONE;
+        for (auto& entry : groups) {
+            Group& group = entry.second;
+            imm_error_code error_code = imm_output_audio_float(imm_instance, room_id, group.members.front(), group.buffer.data());
+            renders++;
+            if (error_code != IMM_ERROR_NONE && result == IMM_ERROR_NONE) {
+                result = error_code;
+            }
+        }
+        outputs += listeners.size();
+        return result;
+    }
+
+    // The listener's output of the last render(), shared with the rest of its group, or NULL
+    const float* output(int participant_id) const
+    {
+        auto listener = listeners.find(participant_id);
+        if (listener == listeners.end()) {
+            return NULL;
+        }
+        return groups.find(listener->second)->second.buffer.data();
+    }
+
+    size_t get_num_listeners() const { return listeners.size(); }
+    size_t get_num_groups() const { return groups.size(); }
+    long long get_renders() const { return renders; }
+    long long get_outputs() const { return outputs; }
+
+private:
+    // Position, azimuth, elevation and state key
+    typedef std::tuple<int, int, int, int, int, long long> Perspective;
+
+    struct Group
+    {
+        std::vector<int> members;       // the first one is rendered
+        std::vector<float> buffer;
+    };
+
+    void leave_group(int participant_id, const Perspective& perspective)
+    {
+        auto group = groups.find(perspective);
+        if (group == groups.end()) {
+            return;
+        }
+        std::vector<int>& members = group->second.members;
+        for (size_t m = 0; m < members.size(); m++) {
+            if (members[m] == participant_id) {
+                members.erase(members.begin() + m);
+                break;
+            }
+        }
+        if (members.empty()) {
+            groups.erase(group);
+        }
+    }
+
+    imm_handle imm_instance;
+    int room_id;
+    int block_size;
+    std::map<int, Perspective> listeners;
+    std::map<Perspective, Group> groups;
+    long long renders = 0;
+    long long outputs = 0;
+};
@@ -1,198 +1,663 @@
-#include "immersitech.h"
-#include "immersitech_logger.h"
-
-#include "audiofile.h"
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdint.h>
-
-#define OUTPUT_SAMPLE_RATE (48000)
-#define OUTPUT_NUM_FRAMES (480)
-
-imm_participant_configuration participant_config;
-imm_error_code error_code;
-
-/*
-
-This command line tool takes an input wav file and processes it through the SDK. The processed
-audio is stored as a wav file.
-
-SYNTAX:
-3d_mixing_demo.exe <input_1.wav> <input_2.wav> ... <input_N.wav>
-
-*/
-int main(int argc, const char* argv[])
-{
-    if (argc < 2)
-    {
-        std::cout << "Usage: \n3d_mixing_demo.exe <input_1.wav> <input_2.wav> ... <input_N.wav> \nThe input wav files MUST be mono and have a sample rate of 48kHz." << std::endl;
-        return 1;
-    }
-
-    // We will keep track of how many participants there are as the number of files input on the command line
-	int number_participants = argc - 1;
-
-	// We can save information about each participant to reference them later
-	int i;
-	int* participant_sampling_rates		= (int*)malloc(number_participants * sizeof(int));	// The sampling rate of each input file
-	int* participant_num_channels		= (int*)malloc(number_participants * sizeof(int));	// The number of channels in each input file
-	int* participant_num_input_frames	= (int*)malloc(number_participants * sizeof(int));	// How many frames this participant will need to input each buffer
-    
-    imm_enable_logging(true);
-    imm_set_log_level(imm_log_level::IMM_LOG_DEBUG);
-
-    /* Initialize IMM library */
-    imm_library_configuration config;
-    config.interleaved = false;
-    config.output_number_channels = 2;
-    config.output_number_frames = OUTPUT_NUM_FRAMES;
-    config.output_sampling_rate = OUTPUT_SAMPLE_RATE;
-    config.spatial_quality = 3;
-
-    imm_handle imm_instance = imm_initialize_library("Immersitech_Engineering_sound_manager_license_key.dat", NULL, NULL, config, &error_code);
-    if (error_code != IMM_ERROR_NONE)
-    {
-        /* Error */
-        std::cout << "imm_initialize_library failed with error code " << error_code <<std::endl;
-    }
-    
-    /* Create room */
-    int room_id = 0;
-    error_code = imm_create_room(imm_instance, room_id);
-    if (error_code != IMM_ERROR_NONE) {
-        /* Error */
-        std::cout << "imm_create_room failed with error code " << error_code <<std::endl;
-    }
-
-    /* Load input files */
-    int maxNumSamples = 0;
-    AudioFile<float>* inputFiles = new AudioFile<float>[number_participants];
-    for (int i = 0; i < number_participants; i++) {
-        bool loadedOK = inputFiles[i].load(argv[i+1]);
-        if (loadedOK == false) {
-            /* Error */
-            std::cout << "Failed to load input file " << argv[i+1] << std::endl;
-        }
-        participant_sampling_rates[i] = inputFiles[i].getSampleRate();
-        participant_num_channels[i] = inputFiles[i].getNumChannels();
-        participant_num_input_frames[i] = (OUTPUT_NUM_FRAMES * participant_sampling_rates[i]) / OUTPUT_SAMPLE_RATE;
-
-        maxNumSamples = std::max(maxNumSamples, inputFiles[i].getNumSamplesPerChannel());
-    }
-
-    /* Create output files */
-    AudioFile<float>* outputFiles = new AudioFile<float>[number_participants];
-    for (int i = 0; i < number_participants; i++) {
-        outputFiles[i].setSampleRate(OUTPUT_SAMPLE_RATE);
-        outputFiles[i].setNumChannels(2);
-        outputFiles[i].setNumSamplesPerChannel(maxNumSamples + OUTPUT_SAMPLE_RATE);
-    }
-    
-    /* Add each participant to the room */
-    for (int i = 0; i < number_participants; i++) {
-        participant_config.input_number_channels = participant_num_channels[i];
-        participant_config.input_sampling_rate = participant_sampling_rates[i];
-        participant_config.type = IMM_PARTICIPANT_REGULAR;
-        error_code = imm_add_participant(imm_instance, room_id, i, "participant", participant_config);
-        if (error_code != IMM_ERROR_NONE) {
-            /* Error */
-            std::cout << "imm_add_participant failed with error code " << error_code <<std::endl;
-        }
-    }
-
-    /* Ensure 3D mixing is enabled for all participants */
-    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
-    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ATTENUATION, 6);
-	imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_MAX_DISTANCE, 300);
-
-    /* Set each participant's location in the room */
-	imm_position position = { 0,0,0 };
-	imm_heading heading = { 0,0 };
-	for (i = 0; i < number_participants; i++) {
-		/* Randomize the positions of the participants
-		   Also be aware of the heading for each participant. 
-           The direction they are facing will change their 
-           perspective of the 3d scene. */
-		if (i % 2) {
-			position.x = i * 20;
-			position.z = i * 30;
-		}
-		else {
-			position.x = i * -50;
-			position.z = i * 50;
-			heading.azimuth_heading = 135;
-		}
-		imm_set_participant_position(imm_instance, room_id, i, position, heading);
-	}
-
-    float* input_buffer = new float[2048];
-    float* output_buffer = new float[2048];
-    int s = 0;
-    while (1) {
-        /* In this example, we will just end when the first file is finished */
-        if (s*participant_num_input_frames[0] > inputFiles[0].getNumSamplesPerChannel()){
-            break;
-        }
-
-        /* Input audio for each participant */
-        for (int i = 0; i < number_participants; i++) {
-            if (participant_num_channels[i] == 1) {
-                memcpy(input_buffer, &inputFiles[i].samples[0][s * participant_num_input_frames[i]], participant_num_input_frames[i] * sizeof(float));
-            }
-            else {
-                memcpy(input_buffer, &inputFiles[i].samples[0][s * participant_num_input_frames[i]], participant_num_input_frames[i] * sizeof(float));
-                memcpy(input_buffer + participant_num_input_frames[i], &inputFiles[i].samples[1][s * participant_num_input_frames[i]], participant_num_input_frames[i] * sizeof(float));
-            }
-            error_code = imm_input_audio_float(imm_instance, room_id, i, input_buffer, participant_num_input_frames[i]);
-            if (error_code != IMM_ERROR_NONE) {
-                /* Error */
-                std::cout << "imm_input_audio_float for participant failed with error code " << error_code <<std::endl;
-            }
-        }
-
-        /* Get the output audio for each participant */
-        for (int i = 0; i < number_participants; i++) {
-            error_code = imm_output_audio_float(imm_instance, room_id, i, output_buffer);
-            if (error_code != IMM_ERROR_NONE) {
-                /* Error */
-                std::cout << "imm_output_audio_float for participant failed with error code " << error_code <<std::endl;
-            }
-            memcpy(&outputFiles[i].samples[0][s * OUTPUT_NUM_FRAMES], output_buffer, OUTPUT_NUM_FRAMES * sizeof(float));
-            memcpy(&outputFiles[i].samples[1][s * OUTPUT_NUM_FRAMES], output_buffer + OUTPUT_NUM_FRAMES, OUTPUT_NUM_FRAMES * sizeof(float));
-        }
-        s = s+1;
-    }
-
-    /* Write the output files */
-    for (int i = 0; i < number_participants; i++) {
-        std::string file_name = "outfile_" + std::to_string(i+1) + ".wav";
-        outputFiles[i].setBitDepth(16);
-        outputFiles[i].save(file_name, AudioFileFormat::Wave);
-    }
-
-    /* Remove participants */
-    for (int i = 0; i < number_participants; i++) {
-        error_code = imm_remove_participant(imm_instance, room_id, i);
-        if (error_code != IMM_ERROR_NONE) {
-            /* Error */
-            std::cout << "imm_remove_participant failed with error code " << error_code <<std::endl;
-        }
-    }
-
-    /* Destroy room */
-    error_code = imm_destroy_room(imm_instance, room_id);
-    if (error_code != IMM_ERROR_NONE) {
-        /* Error */
-        std::cout << "imm_destroy_room failed with error code " << error_code <<std::endl;
-    }
-
-    /* Destroy library */
-    error_code = imm_destroy_library(imm_instance);
-    if (error_code != IMM_ERROR_NONE) {
-        /* Error */
-        std::cout << "imm_destroy_library failed with error code " << error_code <<std::endl;
-    }
-
-	return 0;
-}
+#define IMM_ALLOC_TRACKER_IMPLEMENTATION
+#define IMM_RT_CHECKER_IMPLEMENTATION
+#include "immersitech.h"
+#include "immersitech_logger.h"
+
+#include "alloc_tracker.h"
+#include "deadline_monitor.h"
+#include "input_reader.h"
+#include "listener_groups.h"
+#include "metrics.h"
+#include "output_writer.h"
+#include "perf_counters.h"
+#include "rt_checker.h"
+#include "trace_events.h"
+#include "trajectories.h"
+#include "voice_gate.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE (48000)
+#define OUTPUT_NUM_FRAMES (480)
+#define ALLOC_WARMUP_BLOCKS (10)
+
+imm_participant_configuration participant_config;
+imm_error_code error_code;
+
+/* Stages of the mixing loop that can be measured with --perf-counters and checked with --alloc-check and --rt-check */
+enum MixingStage
+{
+    STAGE_READ = 0,
+    STAGE_INPUT,
+    STAGE_OUTPUT,
+    STAGE_WRITE,
+    STAGE_SAVE
+};
+
+/*
+
+This command line tool takes an input wav file and processes it through the SDK. The processed
+audio is stored as a wav file. Background threads read the inputs ahead of the mixing and write
+the outputs behind it.
+
+SYNTAX:
+3d_mixing_demo.exe [options] <input_1.wav> <input_2.wav> ... <input_N.wav>
+
+OPTIONS:
+--perf-counters     Measure cycles, instructions, cache and branch misses of every stage and report IPC
+--perf-csv FILE     Like --perf-counters, and also write the counters of every block to FILE
+--alloc-check       Fail the run if anything allocates in the mixing loop, once warmed up
+--rt-check          Fail the run on locks, blocking calls or page faults in the mixing loop, once warmed up
+--trace FILE        Record a timeline of every input and output call and write it to FILE as Chrome trace-event JSON
+--metrics FILE      Write Prometheus metrics to FILE every second while mixing
+--metrics-port N    Serve Prometheus metrics on http://127.0.0.1:N/metrics while mixing
+--deadlines         Check every block against its real-time deadline and report the overruns
+--realtime          Like --deadlines, and also wait for each block's real-time period instead of mixing ahead
+--deadline-alert N  Log an alert when N blocks of a room overrun within 100 blocks (default 5, implies --deadlines)
+--interleaved       Configure the library for interleaved audio instead of one channel after the other
+--move KIND         Move the participants while mixing: waypoints, circle or walk
+--control-rate N    Position updates per second while moving (default 20)
+--move-threshold N  Only update a position once it moved N units or turned N degrees (default 1 and 2)
+--vad               Skip imm_input_audio_float for participants who are not talking
+--vad-hangover N    Blocks the voice gate stays open after talking stops (default 30)
+--audience N        Add N listener-only participants, all on one seat at the back of the room
+--shared-mix        Render the audience once per group of listeners that hear the same thing
+--flush-blocks N    Bring the output files up to date on disk every N blocks (default 50)
+
+*/
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, const char* argv[])
+{
+    /* Options come first, the remaining arguments are the input files */
+    bool perf_counters = false;
+    const char* perf_csv = NULL;
+    bool alloc_check = false;
+    bool rt_check = false;
+    const char* trace_path = NULL;
+    const char* metrics_path = NULL;
+    int metrics_port = 0;
+    bool deadlines = false;
+    bool realtime = false;
+    bool interleaved = false;
+    const char* move_kind = NULL;
+    TrajectorySettings trajectory_settings;
+    bool vad = false;
+    VoiceGateSettings gate_settings;
+    int audience_size = 0;
+    bool shared_mix = false;
+    OutputWriterSettings writer_settings;
+    DeadlineSettings deadline_settings;
+    deadline_settings.period_seconds = (double)OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+    int first_file = 1;
+    while (first_file < argc && strncmp(argv[first_file], "--", 2) == 0) {
+        if (strcmp(argv[first_file], "--perf-counters") == 0) {
+            perf_counters = true;
+        }
+        else if (strcmp(argv[first_file], "--perf-csv") == 0 && first_file + 1 < argc) {
+            perf_counters = true;
+            perf_csv = argv[++first_file];
+        }
+        else if (strcmp(argv[first_file], "--alloc-check") == 0) {
+            alloc_check = true;
+        }
+        else if (strcmp(argv[first_file], "--rt-check") == 0) {
+            rt_check = true;
+        }
+        else if (strcmp(argv[first_file], "--trace") == 0 && first_file + 1 < argc) {
+            trace_path = argv[++first_file];
+        }
+        else if (strcmp(argv[first_file], "--metrics") == 0 && first_file + 1 < argc) {
+            metrics_path = argv[++first_file];
+        }
+        else if (strcmp(argv[first_file], "--metrics-port") == 0 && first_file + 1 < argc) {
+            metrics_port = atoi(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--deadlines") == 0) {
+            deadlines = true;
+        }
+        else if (strcmp(argv[first_file], "--realtime") == 0) {
+            deadlines = realtime = true;
+        }
+        else if (strcmp(argv[first_file], "--interleaved") == 0) {
+            interleaved = true;
+        }
+        else if (strcmp(argv[first_file], "--move") == 0 && first_file + 1 < argc) {
+            move_kind = argv[++first_file];
+            if (strcmp(move_kind, "waypoints") != 0 && strcmp(move_kind, "circle") != 0 && strcmp(move_kind, "walk") != 0) {
+                std::cout << "--move must be waypoints, circle or walk" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[first_file], "--control-rate") == 0 && first_file + 1 < argc) {
+            trajectory_settings.control_rate = atof(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--move-threshold") == 0 && first_file + 1 < argc) {
+            trajectory_settings.min_move = trajectory_settings.min_turn = atof(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--vad") == 0) {
+            vad = true;
+        }
+        else if (strcmp(argv[first_file], "--vad-hangover") == 0 && first_file + 1 < argc) {
+            vad = true;
+            gate_settings.hangover_blocks = atoi(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--audience") == 0 && first_file + 1 < argc) {
+            audience_size = std::max(0, atoi(argv[++first_file]));
+        }
+        else if (strcmp(argv[first_file], "--shared-mix") == 0) {
+            shared_mix = true;
+        }
+        else if (strcmp(argv[first_file], "--flush-blocks") == 0 && first_file + 1 < argc) {
+            writer_settings.flush_blocks = atoi(argv[++first_file]);
+        }
+        else if (strcmp(argv[first_file], "--deadline-alert") == 0 && first_file + 1 < argc) {
+            deadlines = true;
+            deadline_settings.alert_overruns = atoi(argv[++first_file]);
+        }
+        else {
+            std::cout << "Unknown option " << argv[first_file] << std::endl;
+            return 1;
+        }
+        first_file++;
+    }
+
+    if (argc - first_file < 1)
+    {
+        std::cout << "Usage: \n3d_mixing_demo.exe [--perf-counters] [--perf-csv FILE] [--alloc-check] [--rt-check] [--trace FILE] [--metrics FILE] [--metrics-port N] [--deadlines] [--realtime] [--deadline-alert N] [--interleaved] [--move KIND] [--control-rate N] [--move-threshold N] [--vad] [--vad-hangover N] [--audience N] [--shared-mix] [--flush-blocks N] <input_1.wav> <input_2.wav> ... <input_N.wav> \nThe input wav files MUST be mono and have a sample rate of 48kHz." << std::endl;
+        return 1;
+    }
+    const char** input_paths = argv + first_file;
+
+    /* Optional hardware counters for each stage of the mixing loop */
+    std::unique_ptr<StageProfiler> profiler;
+    if (perf_counters) {
+        profiler.reset(new StageProfiler({ "read", "imm_input_audio_float", "imm_output_audio_float", "write", "save" }));
+    }
+
+    /* Optional timeline of the mixing loop, open the file in Perfetto */
+    std::unique_ptr<TraceRecorder> tracer;
+    if (trace_path != NULL) {
+        tracer.reset(new TraceRecorder());
+        tracer->name_thread("mixing");
+    }
+
+    /* Allocations are counted per stage, registered in MixingStage order so the scope ids match */
+    AllocTracker::register_scope("read");
+    AllocTracker::register_scope("imm_input_audio_float");
+    AllocTracker::register_scope("imm_output_audio_float");
+    AllocTracker::register_scope("write");
+    AllocTracker::name_thread("main");
+    AllocTracker::enable_checks(alloc_check);
+
+    /* The same stages are real-time regions for --rt-check */
+    RtChecker::register_region("read");
+    RtChecker::register_region("imm_input_audio_float");
+    RtChecker::register_region("imm_output_audio_float");
+    RtChecker::register_region("write");
+    RtChecker::enable_checks(rt_check);
+
+    // We will keep track of how many participants there are as the number of files input on the command line
+	int number_participants = argc - first_file;
+
+	// We can save information about each participant to reference them later
+	int i;
+	int* participant_sampling_rates		= (int*)malloc(number_participants * sizeof(int));	// The sampling rate of each input file
+	int* participant_num_channels		= (int*)malloc(number_participants * sizeof(int));	// The number of channels in each input file
+	int* participant_num_input_frames	= (int*)malloc(number_participants * sizeof(int));	// How many frames this participant will need to input each buffer
+    
+    imm_enable_logging(true);
+    imm_set_log_level(imm_log_level::IMM_LOG_DEBUG);
+
+    /* Initialize IMM library */
+    imm_library_configuration config;
+    config.interleaved = interleaved;
+    config.output_number_channels = 2;
+    config.output_number_frames = OUTPUT_NUM_FRAMES;
+    config.output_sampling_rate = OUTPUT_SAMPLE_RATE;
+    config.spatial_quality = 3;
+
+    imm_handle imm_instance = imm_initialize_library("Immersitech_Engineering_sound_manager_license_key.dat", NULL, NULL, config, &error_code);
+    if (error_code != IMM_ERROR_NONE)
+    {
+        /* Error */
+        std::cout << "imm_initialize_library failed with error code " << error_code <<std::endl;
+    }
+    
+    /* Create room */
+    int room_id = 0;
+    error_code = imm_create_room(imm_instance, room_id);
+    if (error_code != IMM_ERROR_NONE) {
+        /* Error */
+        std::cout << "imm_create_room failed with error code " << error_code <<std::endl;
+    }
+
+    /* Open input files. Only their headers are read here; the reader thread starts reading their
+       audio right away and keeps a few hundred milliseconds of every file ready for mixing. */
+    InputReader input_reader(config.interleaved);
+    for (int i = 0; i < number_participants; i++) {
+        if (input_reader.add_stream(input_paths[i], OUTPUT_NUM_FRAMES, OUTPUT_SAMPLE_RATE) != i) {
+            /* Error */
+            std::cout << "Failed to load input file " << input_paths[i] << std::endl;
+            return 1;
+        }
+        participant_sampling_rates[i] = input_reader.get_sample_rate(i);
+        participant_num_channels[i] = input_reader.get_num_channels(i);
+        participant_num_input_frames[i] = input_reader.get_frames_per_block(i);
+    }
+    input_reader.start();
+
+    /* The loop below runs until the first file is finished. Shorter inputs are silent after their end. */
+    int num_blocks = (int)(input_reader.get_num_frames(0) / participant_num_input_frames[0]) + 1;
+
+    /* Create output files. The mixing loop renders each block straight into the writer's queue for
+       its file, and the writer thread appends it, so only a few blocks per file are ever in memory. */
+    OutputWriter output_writer(config.interleaved, config.output_number_channels, config.output_number_frames, OUTPUT_SAMPLE_RATE, writer_settings);
+    for (int i = 0; i < number_participants; i++) {
+        std::string file_name = "outfile_" + std::to_string(i+1) + ".wav";
+        if (output_writer.add_stream(file_name) != i) {
+            /* Error */
+            std::cout << "Failed to create output file " << file_name << std::endl;
+            return 1;
+        }
+    }
+    int audience_stream = audience_size > 0 ? output_writer.add_stream("outfile_audience.wav") : -1;
+    
+    /* Metrics of the room, exported while mixing with --metrics or --metrics-port */
+    MetricsRegistry metrics;
+    std::string room_label = metric_label("room", room_id);
+    MetricCounter* blocks_processed = metrics.counter("imm_blocks_processed_total", "Blocks mixed", room_label);
+    MetricCounter* block_overruns = metrics.counter("imm_block_overruns_total", "Blocks that took longer than their real-time period to mix", room_label);
+    MetricHistogram* block_duration = metrics.histogram("imm_block_duration_seconds", "Time to mix one block", MetricHistogram::latency_buckets(), room_label);
+    MetricHistogram* input_duration = metrics.histogram("imm_call_duration_seconds", "Duration of imm_* calls", MetricHistogram::latency_buckets(),
+                                                        room_label + "," + metric_label("call", "imm_input_audio_float"));
+    MetricHistogram* output_duration = metrics.histogram("imm_call_duration_seconds", "Duration of imm_* calls", MetricHistogram::latency_buckets(),
+                                                         room_label + "," + metric_label("call", "imm_output_audio_float"));
+    MetricGauge* active_participants = metrics.gauge("imm_active_participants", "Participants in the room", room_label);
+    MetricCounter* inputs_gated = metrics.counter("imm_inputs_gated_total", "imm_input_audio_float calls skipped because the participant was silent", room_label);
+
+    /* Every call/code series is registered here, so counting an error in the mixing loop never
+       takes the registry's lock or allocates. Codes not listed are counted as code="other". */
+    MetricErrorCounters imm_errors(metrics, "imm_errors_total", "Error codes returned by imm_* calls", room_label,
+                                   { "imm_add_participant", "imm_input_audio_float", "imm_output_audio_float", "imm_remove_participant" },
+                                   { IMM_ERROR_NO_INPUT_AUDIO, IMM_ERROR_HANDLE_NULL, IMM_ERROR_INVALID_CONFIGURATION, IMM_ERROR_ROOM_NOT_FOUND,
+                                     IMM_ERROR_PARTICIPANT_NOT_FOUND, IMM_ERROR_PARTICIPANT_ALREADY_EXISTS });
+    const double block_period = (double)OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+    std::unique_ptr<MetricsExporter> metrics_exporter;
+    if (metrics_path != NULL || metrics_port > 0) {
+        metrics_exporter.reset(new MetricsExporter(&metrics, metrics_path, metrics_port));
+    }
+
+    /* Add each participant to the room */
+    for (int i = 0; i < number_participants; i++) {
+        participant_config.input_number_channels = participant_num_channels[i];
+        participant_config.input_sampling_rate = participant_sampling_rates[i];
+        participant_config.type = IMM_PARTICIPANT_REGULAR;
+        error_code = imm_add_participant(imm_instance, room_id, i, "participant", participant_config);
+        imm_errors.count("imm_add_participant", error_code);
+        if (error_code == IMM_ERROR_NONE) {
+            active_participants->add(1);
+        }
+        else {
+            /* Error */
+            std::cout << "imm_add_participant failed with error code " << error_code <<std::endl;
+        }
+    }
+
+    /* The audience listens from participant ids after the talkers' */
+    int first_listener = number_participants;
+    for (int a = 0; a < audience_size; a++) {
+        participant_config.input_number_channels = 1;
+        participant_config.input_sampling_rate = OUTPUT_SAMPLE_RATE;
+        participant_config.type = IMM_PARTICIPANT_LISTENER_ONLY;
+        error_code = imm_add_participant(imm_instance, room_id, first_listener + a, "listener", participant_config);
+        imm_errors.count("imm_add_participant", error_code);
+        if (error_code == IMM_ERROR_NONE) {
+            active_participants->add(1);
+        }
+        else {
+            /* Error */
+            std::cout << "imm_add_participant failed for a listener with error code " << error_code <<std::endl;
+        }
+    }
+
+    /* Ensure 3D mixing is enabled for all participants */
+    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
+    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ATTENUATION, 6);
+	imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_MAX_DISTANCE, 300);
+
+    /* Set each participant's location in the room */
+	imm_position position = { 0,0,0 };
+	imm_heading heading = { 0,0 };
+	std::vector<imm_position> seats;
+	for (i = 0; i < number_participants; i++) {
+		/* Randomize the positions of the participants
+		   Also be aware of the heading for each participant. 
+           The direction they are facing will change their 
+           perspective of the 3d scene. */
+		if (i % 2) {
+			position.x = i * 20;
+			position.z = i * 30;
+		}
+		else {
+			position.x = i * -50;
+			position.z = i * 50;
+			heading.azimuth_heading = 135;
+		}
+		imm_set_participant_position(imm_instance, room_id, i, position, heading);
+		seats.push_back(position);
+	}
+
+    /* The whole audience sits on one seat at the back, facing the talkers. With --shared-mix they
+       form one group and the room is rendered for them once per block, otherwise once per listener. */
+    imm_position audience_seat = { 0, 0, -200 };
+    imm_heading audience_heading = { 0, 0 };
+    std::unique_ptr<ListenerGroups> listener_groups;
+    if (shared_mix) {
+        listener_groups.reset(new ListenerGroups(imm_instance, room_id, config.output_number_channels * config.output_number_frames));
+    }
+    for (int a = 0; a < audience_size; a++) {
+        if (listener_groups) {
+            listener_groups->place(first_listener + a, audience_seat, audience_heading);
+        }
+        else {
+            imm_set_participant_position(imm_instance, room_id, first_listener + a, audience_seat, audience_heading);
+        }
+    }
+    std::vector<float> audience_buffers(shared_mix ? 0 : (size_t)audience_size * config.output_number_channels * config.output_number_frames);
+    std::vector<const float*> audience_outputs(audience_size);
+    long long audience_calls = 0;
+    double audience_seconds = 0;
+
+    /* With --move, the participants leave their seats and move around the room while mixing */
+    std::unique_ptr<TrajectoryEngine> trajectories;
+    if (move_kind != NULL) {
+        trajectories.reset(new TrajectoryEngine(imm_instance, trajectory_settings));
+        for (int i = 0; i < number_participants; i++) {
+            imm_position seat = seats[i];
+            if (strcmp(move_kind, "waypoints") == 0) {
+                /* Pace a 100 unit square starting at the seat */
+                std::vector<imm_position> corners = { seat, { seat.x + 100, seat.y, seat.z }, { seat.x + 100, seat.y, seat.z + 100 }, { seat.x, seat.y, seat.z + 100 } };
+                trajectories->add(room_id, i, Trajectory::waypoints(corners, 100));
+            }
+            else if (strcmp(move_kind, "circle") == 0) {
+                /* Circle the center of the room at the seat's distance, one lap every 10 to 20 seconds */
+                double radius = std::max(50.0, sqrt((double)seat.x * seat.x + (double)seat.z * seat.z));
+                double start_degrees = atan2((double)seat.z, (double)seat.x) * 180.0 / 3.14159265358979323846;
+                trajectories->add(room_id, i, Trajectory::circle({ 0, 0, 0 }, radius, 10.0 + i % 11, start_degrees));
+            }
+            else {
+                trajectories->add(room_id, i, Trajectory::random_walk(seat, 100, 150, (unsigned int)i + 1));
+            }
+        }
+    }
+
+    /* Optional check of every block against a wall-clock schedule, starting now */
+    std::unique_ptr<DeadlineMonitor> deadline_monitor;
+    if (deadlines) {
+        deadline_monitor.reset(new DeadlineMonitor(deadline_settings));
+        deadline_monitor->add_room(room_id);
+        deadline_monitor->start_room(room_id);
+    }
+
+    /* With --vad, a voice gate per participant decides whether their input is worth processing */
+    std::vector<VoiceGate> voice_gates;
+    if (vad) {
+        voice_gates.assign(number_participants, VoiceGate(gate_settings));
+    }
+
+    int block_output_size = config.output_number_channels * config.output_number_frames;
+
+    /* Returns a participant's input for block s, in the library's layout, once the reader has it */
+    auto acquire_input = [&](int i, int s) {
+        StageScope scope(profiler.get(), STAGE_READ, s);
+        AllocScope alloc_scope(STAGE_READ, s >= ALLOC_WARMUP_BLOCKS);
+        RtRegion rt_region(STAGE_READ, s >= ALLOC_WARMUP_BLOCKS);
+        return input_reader.acquire(i);
+    };
+
+    /* Returns the buffer to render a file's output of block s into, once the writer has room for it */
+    auto acquire_output = [&](int stream, int s) {
+        StageScope scope(profiler.get(), STAGE_WRITE, s);
+        AllocScope alloc_scope(STAGE_WRITE, s >= ALLOC_WARMUP_BLOCKS);
+        RtRegion rt_region(STAGE_WRITE, s >= ALLOC_WARMUP_BLOCKS);
+        return output_writer.acquire(stream);
+    };
+
+    output_writer.start();
+
+    for (int s = 0; s < num_blocks; s++) {
+        bool steady = s >= ALLOC_WARMUP_BLOCKS;
+        if (realtime) {
+            /* Like an audio callback, the block is only available once its period starts */
+            std::this_thread::sleep_until(deadline_monitor->release_time(room_id, s));
+        }
+        TraceSpan block_span(tracer.get(), "block", room_id, -1, s);
+        std::chrono::steady_clock::time_point block_start = std::chrono::steady_clock::now();
+
+        /* Move the participants to where they are at the start of this block */
+        if (trajectories) {
+            TraceSpan span(tracer.get(), "move participants", room_id, -1, s);
+            trajectories->update(s * block_period);
+        }
+
+        /* Input audio for each participant */
+        for (int i = 0; i < number_participants; i++) {
+            const float* input = acquire_input(i, s);
+            if (vad && !voice_gates[i].process(input, (size_t)participant_num_channels[i] * participant_num_input_frames[i])) {
+                /* Silent participants are left out of this block's mix altogether */
+                inputs_gated->add();
+                input_reader.release(i);
+                continue;
+            }
+            {
+                StageScope scope(profiler.get(), STAGE_INPUT, s);
+                AllocScope alloc_scope(STAGE_INPUT, steady);
+                RtRegion rt_region(STAGE_INPUT, steady);
+                TraceSpan span(tracer.get(), "imm_input_audio_float", room_id, i, s);
+                std::chrono::steady_clock::time_point call_start = std::chrono::steady_clock::now();
+                error_code = imm_input_audio_float(imm_instance, room_id, i, input, participant_num_input_frames[i]);
+                input_duration->observe(seconds_since(call_start));
+            }
+            input_reader.release(i);
+            imm_errors.count("imm_input_audio_float", error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                /* Error */
+                std::cout << "imm_input_audio_float for participant failed with error code " << error_code <<std::endl;
+            }
+        }
+
+        /* Get the output audio for each participant */
+        for (int i = 0; i < number_participants; i++) {
+            float* output = acquire_output(i, s);
+            {
+                StageScope scope(profiler.get(), STAGE_OUTPUT, s);
+                AllocScope alloc_scope(STAGE_OUTPUT, steady);
+                RtRegion rt_region(STAGE_OUTPUT, steady);
+                TraceSpan span(tracer.get(), "imm_output_audio_float", room_id, i, s);
+                std::chrono::steady_clock::time_point call_start = std::chrono::steady_clock::now();
+                error_code = imm_output_audio_float(imm_instance, room_id, i, output);
+                output_duration->observe(seconds_since(call_start));
+            }
+            if (vad && error_code == IMM_ERROR_NO_INPUT_AUDIO) {
+                /* Everyone in the room is silent, which the gate makes a normal state */
+                memset(output, 0, block_output_size * sizeof(float));
+                error_code = IMM_ERROR_NONE;
+            }
+            imm_errors.count("imm_output_audio_float", error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                /* Error */
+                std::cout << "imm_output_audio_float for participant failed with error code " << error_code <<std::endl;
+            }
+            output_writer.commit(i);
+        }
+
+        /* Render the audience's output, and keep what the first listener heard */
+        if (audience_size > 0) {
+            TraceSpan span(tracer.get(), "audience", room_id, -1, s);
+            std::chrono::steady_clock::time_point audience_start = std::chrono::steady_clock::now();
+            if (listener_groups) {
+                error_code = listener_groups->render();
+                for (int a = 0; a < audience_size; a++) {
+                    audience_outputs[a] = listener_groups->output(first_listener + a);
+                }
+                audience_calls += listener_groups->get_num_groups();
+            }
+            else {
+                error_code = IMM_ERROR_NONE;
+                for (int a = 0; a < audience_size; a++) {
+                    float* output = audience_buffers.data() + (size_t)a * block_output_size;
+                    imm_error_code listener_error = imm_output_audio_float(imm_instance, room_id, first_listener + a, output);
+                    if (error_code == IMM_ERROR_NONE) {
+                        error_code = listener_error;
+                    }
+                    audience_outputs[a] = output;
+                }
+                audience_calls += audience_size;
+            }
+            audience_seconds += seconds_since(audience_start);
+            if (vad && error_code == IMM_ERROR_NO_INPUT_AUDIO) {
+                error_code = IMM_ERROR_NONE;
+            }
+            imm_errors.count("imm_output_audio_float", error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                /* Error */
+                std::cout << "imm_output_audio_float for the audience failed with error code " << error_code <<std::endl;
+            }
+            memcpy(acquire_output(audience_stream, s), audience_outputs[0], block_output_size * sizeof(float));
+            output_writer.commit(audience_stream);
+        }
+
+        double block_seconds = seconds_since(block_start);
+        blocks_processed->add();
+        block_duration->observe(block_seconds);
+        if (block_seconds > block_period) {
+            block_overruns->add();
+        }
+        if (deadline_monitor) {
+            deadline_monitor->block_finished(room_id, s);
+        }
+    }
+
+    input_reader.finish();
+    input_reader.print_report();
+
+    /* Write out the last blocks and close the output files */
+    bool outputs_written;
+    {
+        StageScope scope(profiler.get(), STAGE_SAVE, 0);
+        outputs_written = output_writer.finish();
+    }
+    output_writer.print_report();
+
+    if (audience_size > 0) {
+        char line[256];
+        snprintf(line, sizeof(line), "Rendered %d listeners with %lld imm_output_audio_float calls for %lld outputs, in %.1f ms",
+                 audience_size, audience_calls, (long long)num_blocks * audience_size, 1000.0 * audience_seconds);
+        std::cout << line << std::endl;
+    }
+
+    /* Report the hardware counters */
+    if (profiler) {
+        profiler->print_report();
+        if (perf_csv != NULL) {
+            profiler->write_csv(perf_csv);
+        }
+    }
+    if (alloc_check) {
+        AllocTracker::print_report();
+    }
+    if (rt_check) {
+        RtChecker::print_report();
+    }
+    if (tracer) {
+        tracer->write_json(trace_path);
+    }
+    if (deadline_monitor) {
+        deadline_monitor->print_report();
+    }
+    if (trajectories) {
+        trajectories->print_report();
+    }
+    if (vad) {
+        char line[256];
+        long long gated = 0;
+        for (int i = 0; i < number_participants; i++) {
+            long long blocks = voice_gates[i].get_blocks();
+            gated += blocks - voice_gates[i].get_open_blocks();
+            snprintf(line, sizeof(line), "Participant %d's voice gate was open for %.1f%% of %lld blocks, noise floor %.1f dBFS", i + 1,
+                     blocks > 0 ? 100.0 * voice_gates[i].get_open_blocks() / blocks : 0.0, blocks, voice_gates[i].get_noise_floor_db());
+            std::cout << line << std::endl;
+        }
+        long long calls = (long long)num_blocks * number_participants;
+        snprintf(line, sizeof(line), "The voice gate skipped %lld of %lld imm_input_audio_float calls (%.1f%%)", gated, calls, calls > 0 ? 100.0 * gated / calls : 0.0);
+        std::cout << line << std::endl;
+        snprintf(line, sizeof(line), "imm_input_audio_float and imm_output_audio_float took %.1f ms in all", 1000.0 * (input_duration->sum() + output_duration->sum()));
+        std::cout << line << std::endl;
+    }
+
+    /* Remove participants */
+    for (int i = 0; i < number_participants; i++) {
+        error_code = imm_remove_participant(imm_instance, room_id, i);
+        imm_errors.count("imm_remove_participant", error_code);
+        if (error_code == IMM_ERROR_NONE) {
+            active_participants->add(-1);
+        }
+        else {
+            /* Error */
+            std::cout << "imm_remove_participant failed with error code " << error_code <<std::endl;
+        }
+    }
+
+    for (int a = 0; a < audience_size; a++) {
+        if (listener_groups) {
+            listener_groups->remove(first_listener + a);
+        }
+        error_code = imm_remove_participant(imm_instance, room_id, first_listener + a);
+        imm_errors.count("imm_remove_participant", error_code);
+        if (error_code == IMM_ERROR_NONE) {
+            active_participants->add(-1);
+        }
+    }
+
+    /* Destroy room */
+    error_code = imm_destroy_room(imm_instance, room_id);
+    if (error_code != IMM_ERROR_NONE) {
+        /* Error */
+        std::cout << "imm_destroy_room failed with error code " << error_code <<std::endl;
+    }
+
+    /* Destroy library */
+    error_code = imm_destroy_library(imm_instance);
+    if (error_code != IMM_ERROR_NONE) {
+        /* Error */
+        std::cout << "imm_destroy_library failed with error code " << error_code <<std::endl;
+    }
+
+    /* An input file that could not be read or an output file that could not be written completely fails the run */
+    if (input_reader.has_failed() || !outputs_written) {
+        return 1;
+    }
+
+    /* With --alloc-check or --rt-check, any violation in the steady state fails the run */
+    if (AllocTracker::get_violations() > 0 || RtChecker::get_violations() > 0) {
+        return 1;
+    }
+
+	return 0;
+}
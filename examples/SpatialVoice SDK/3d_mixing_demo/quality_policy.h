@@ -0,0 +1,230 @@
+#pragma once
+
+#include "immersitech.h"
+#include "deadline_monitor.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+/*
+
+Lowers the spatial_quality of new rooms when a server falls behind.
+
+spatial_quality is fixed when a library instance is initialized, so a server cannot turn down
+the quality of a room that is already mixing. What it can do is put the rooms that open next on
+an instance with a lower quality, which costs less per participant (3d_mixing_bench prints how
+much less). QualityPolicy initializes one instance per level, from start_quality down to
+min_quality, and hands out the current level's instance for every new room:
+
+    QualityPolicy policy(license_filepath, config, settings);
+    DeadlineMonitor deadlines(deadline_settings, [&](const DeadlineAlert& alert) { policy.on_deadline_alert(alert); });
+    ...
+    int quality;
+    imm_handle instance = policy.instance_for_new_room(&quality);
+    imm_create_room(instance, room_id);
+    ...
+    policy.poll();      // on a control thread, every few milliseconds
+
+Alerts arrive on the mixing threads, so on_deadline_alert() only leaves the alert in a mailbox,
+without locking or allocating. poll() takes it from there, steps the level down once and logs
+the change. The rooms already mixing need a little while to feel the change, so alerts are
+ignored for cooldown_seconds after each step. With recover_seconds set, poll() steps the level
+back up after that long without an alert. All members can be called from any thread.
+
+*/
+
+struct QualityPolicySettings
+{
+    int start_quality = 5;
+    int min_quality = 1;
+    double cooldown_seconds = 1.0;      // alerts right after a step are ignored, so one overload only steps once
+    double recover_seconds = 0;         // step back up after this long without an alert, 0 never steps up
+};
+
+struct QualityChange
+{
+    double seconds;                     // since the policy was created
+    int from_quality;
+    int to_quality;
+    int room;                           // room whose alert caused the change, -1 for a recovery
+};
+
+class QualityPolicy
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    QualityPolicy(const char* license_filepath, imm_library_configuration config, const QualityPolicySettings& settings)
+        : settings(settings), created(Clock::now()),
+          last_change(created - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.cooldown_seconds)))
+    {
+        this->settings.start_quality = std::max(1, std::min(5, settings.start_quality));
+        this->settings.min_quality = std::max(1, std::min(this->settings.start_quality, settings.min_quality));
+        for (int quality = this->settings.min_quality; quality <= this->settings.start_quality; quality++) {
+            config.spatial_quality = quality;
+            imm_error_code error_code;
+            imm_handle instance = imm_initialize_library(license_filepath, NULL, NULL, config, &error_code);
+            if (error_code != IMM_ERROR_NONE) {
+                std::cout << "imm_initialize_library failed at spatial_quality " << quality << " with error code " << error_code << std::endl;
+                instance = NULL;
+            }
+            instances.push_back(instance);
+        }
+        quality = this->settings.start_quality;
+    }
+
+    ~QualityPolicy()
+    {
+        for (imm_handle instance : instances) {
+            if (instance != NULL) {
+                imm_destroy_library(instance);
+            }
+        }
+    }
+
+    QualityPolicy(const QualityPolicy&) = delete;
+    QualityPolicy& operator=(const QualityPolicy&) = delete;
+
+    // False when a level's library instance could not be initialized
+    bool is_ready() const
+    {
+        for (imm_handle instance : instances) {
+            if (instance == NULL) {
+                return false;
+            }
+        }
+        return !instances.empty();
+    }
+
+    // The instance a room opening now should be created in, and its spatial_quality
+    imm_handle instance_for_new_room(int* room_quality = NULL)
+    {
+        int level = quality.load(std::memory_order_relaxed);
+        rooms_per_quality[level]++;
+        if (room_quality != NULL) {
+            *room_quality = level;
+        }
+        return instances[level - settings.min_quality];
+    }
+
+    // The instance of a level, to remove rooms from when they close
+    imm_handle get_instance(int level) const { return instances[level - settings.min_quality]; }
+
+    // Pass every alert of the DeadlineMonitor here. Safe on a real-time thread: it only posts the
+    // alert for poll(), and drops it when an earlier one has not been taken yet.
+    void on_deadline_alert(const DeadlineAlert& alert)
+    {
+        if (!alert.raised) {
+            return;
+        }
+        Clock::rep now = (Clock::now() - created).count();
+        last_alert.store(now, std::memory_order_relaxed);
+        bool busy = false;
+        if (!mailbox_busy.compare_exchange_strong(busy, true, std::memory_order_acquire)) {
+            return;
+        }
+        pending = PendingAlert{ alert.room, alert.overruns_in_window, alert.window_blocks, now };
+        mailbox_full.store(true, std::memory_order_release);
+    }
+
+    // Applies the alert posted since the last call, or steps back up after recover_seconds, and
+    // logs the change. Call it regularly from a thread that is not mixing.
+    void poll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mailbox_full.load(std::memory_order_acquire)) {
+            PendingAlert alert = pending;
+            mailbox_full.store(false, std::memory_order_relaxed);
+            mailbox_busy.store(false, std::memory_order_release);
+            Clock::time_point time = created + Clock::duration(alert.time);
+            int level = quality.load(std::memory_order_relaxed);
+            if (level > settings.min_quality && seconds_between(last_change, time) >= settings.cooldown_seconds) {
+                change(level - 1, alert.room, time);
+                char line[256];
+                snprintf(line, sizeof(line), "[%.3f s] Room %d missed %d of its last %d deadlines, new rooms now get spatial_quality %d",
+                         changes.back().seconds, alert.room, alert.overruns_in_window, alert.window_blocks, level - 1);
+                std::cout << line << std::endl;
+            }
+        }
+        maybe_recover(Clock::now());
+    }
+
+    int get_quality() const { return quality.load(std::memory_order_relaxed); }
+
+    std::vector<QualityChange> get_changes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return changes;
+    }
+
+    void print_report()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "spatial_quality changed " << changes.size() << " times, new rooms end at spatial_quality " << get_quality() << std::endl;
+        for (int level = settings.start_quality; level >= settings.min_quality; level--) {
+            char line[128];
+            snprintf(line, sizeof(line), "  spatial_quality %d: %d rooms", level, rooms_per_quality[level].load());
+            std::cout << line << std::endl;
+        }
+    }
+
+private:
+    static double seconds_between(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double>(to - from).count();
+    }
+
+    // An alert waiting for poll(), with its time in Clock ticks since the policy was created
+    struct PendingAlert
+    {
+        int room;
+        int overruns_in_window;
+        int window_blocks;
+        Clock::rep time;
+    };
+
+    // Called by poll(), with mutex held
+    void change(int to_quality, int room, Clock::time_point now)
+    {
+        changes.push_back(QualityChange{ seconds_between(created, now), quality.load(), to_quality, room });
+        quality.store(to_quality, std::memory_order_relaxed);
+        last_change = now;
+    }
+
+    void maybe_recover(Clock::time_point now)
+    {
+        int level = quality.load(std::memory_order_relaxed);
+        Clock::time_point alert_time = created + Clock::duration(last_alert.load(std::memory_order_relaxed));
+        if (settings.recover_seconds <= 0 || level >= settings.start_quality ||
+            seconds_between(std::max(alert_time, last_change), now) < settings.recover_seconds) {
+            return;
+        }
+        change(level + 1, -1, now);
+        char line[256];
+        snprintf(line, sizeof(line), "[%.3f s] No missed deadlines for %.1f s, new rooms now get spatial_quality %d",
+                 changes.back().seconds, settings.recover_seconds, level + 1);
+        std::cout << line << std::endl;
+    }
+
+    QualityPolicySettings settings;
+    std::vector<imm_handle> instances;      // from min_quality up
+    std::mutex mutex;                       // guards changes and last_change, taken by poll() and the getters
+    std::atomic<int> quality{5};
+    std::atomic<int> rooms_per_quality[6] = {};
+    std::vector<QualityChange> changes;
+    Clock::time_point created;
+    Clock::time_point last_change;          // starts out of cooldown, so the first alert counts
+    std::atomic<Clock::rep> last_alert{0};
+
+    // A single-slot mailbox from the mixing threads to poll(). A thread that wins mailbox_busy
+    // fills pending and sets mailbox_full, poll() empties it and frees it again.
+    std::atomic<bool> mailbox_busy{false};
+    std::atomic<bool> mailbox_full{false};
+    PendingAlert pending = {};
+};
@@ -0,0 +1,339 @@
+#include "immersitech.h"
+#include "deadline_monitor.h"
+#include "quality_policy.h"
+#include "talkers.h"
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE (48000)
+#define OUTPUT_NUM_FRAMES (480)
+
+/*
+
+This command line tool hosts many small rooms in one library instance, the way a production
+server does, and measures how many rooms one core can mix.
+
+The rooms are dealt out round-robin to worker threads, by default one for each CPU the process
+may use, and each worker is pinned to its own one of those CPUs. Every block, a worker inputs
+audio for every participant of each of its rooms and then renders every participant's output,
+one room after the other. The participants say the bundled audio files and sit on a circle in
+their room.
+
+At the end, each worker's load is printed as the share of real time it spent mixing. The
+capacity is the number of rooms divided by the cores' worth of time they needed: that many rooms
+of this size, at this spatial_quality, fit on one core. With --realtime, each block waits for
+its 10ms period to start, like an audio callback would, and every room's deadlines are checked
+as well.
+
+With --adaptive, the rooms do not all open at once but one after another over --open-seconds,
+and the server degrades gracefully under load: --quality is only the spatial_quality the first
+rooms get. Whenever a room keeps missing its deadlines, the rooms that open after it are created
+in a library instance with a lower spatial_quality, and the main thread logs the change. The
+rooms already mixing keep their quality.
+
+SYNTAX:
+3d_mixing_rooms <licensefile> [--rooms N] [--participants N] [--threads N] [--quality N] [--seconds S] [--realtime] [--no-pin] [--adaptive] [--open-seconds S] [--audio-dir DIR]
+
+*/
+
+struct RoomWorker
+{
+    int index = 0;
+    int cpu = -1;
+    bool pinned = false;
+    std::vector<int> rooms;
+    double busy_seconds = 0;
+    double max_block_seconds = 0;
+    long long errors = 0;
+};
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n3d_mixing_rooms <licensefile> [--rooms N] [--participants N] [--threads N] [--quality N] [--seconds S] [--realtime] [--no-pin] [--adaptive] [--open-seconds S] [--audio-dir DIR]" << std::endl;
+        std::cout << "  --rooms N         Rooms to host (default 100)" << std::endl;
+        std::cout << "  --participants N  Participants in every room (default 4)" << std::endl;
+        std::cout << "  --threads N       Worker threads (default: one per CPU the process may use)" << std::endl;
+        std::cout << "  --quality N       spatial_quality from 1 to 5 (default 3)" << std::endl;
+        std::cout << "  --seconds S       Seconds of audio to mix in every room (default 10)" << std::endl;
+        std::cout << "  --realtime        Wait for each block's real-time period and check every room's deadlines" << std::endl;
+        std::cout << "  --no-pin          Let the scheduler move the workers between CPUs" << std::endl;
+        std::cout << "  --adaptive        Open rooms over time and lower the spatial_quality of new rooms when deadlines are missed" << std::endl;
+        std::cout << "  --open-seconds S  With --adaptive, seconds over which the rooms open (default: half of --seconds)" << std::endl;
+        std::cout << "  --audio-dir DIR   Folder with the mono WAV files the participants say (default: the bundled audio_files)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    int num_rooms = 100;
+    int participants_per_room = 4;
+    std::vector<int> allowed_cpus = get_allowed_cpus();
+    int num_threads = (int)allowed_cpus.size();
+    int quality = 3;
+    double seconds = 10;
+    bool realtime = false;
+    bool pin = true;
+    bool adaptive = false;
+    double open_seconds = -1;
+    std::string audio_dir = IMM_AUDIO_FILES_DIR;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--rooms") == 0 && a + 1 < argc) {
+            num_rooms = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--participants") == 0 && a + 1 < argc) {
+            participants_per_room = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+            num_threads = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--quality") == 0 && a + 1 < argc) {
+            quality = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--seconds") == 0 && a + 1 < argc) {
+            seconds = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--realtime") == 0) {
+            realtime = true;
+        }
+        else if (strcmp(argv[a], "--no-pin") == 0) {
+            pin = false;
+        }
+        else if (strcmp(argv[a], "--adaptive") == 0) {
+            adaptive = realtime = true;
+        }
+        else if (strcmp(argv[a], "--open-seconds") == 0 && a + 1 < argc) {
+            open_seconds = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--audio-dir") == 0 && a + 1 < argc) {
+            audio_dir = argv[++a];
+        }
+        else {
+            std::cout << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+    num_threads = std::min(num_threads, num_rooms);
+    const double block_period = (double)OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+    long long num_blocks = std::max(1LL, (long long)(seconds / block_period));
+
+    TalkerAudio talkers;
+    if (!talkers.load(audio_dir, OUTPUT_NUM_FRAMES, OUTPUT_SAMPLE_RATE)) {
+        return 1;
+    }
+    int input_frames = talkers.get_block_frames();
+
+    /* One library instance hosts every room, or with --adaptive one per spatial_quality level */
+    imm_library_configuration config;
+    config.interleaved = false;
+    config.output_number_channels = 2;
+    config.output_number_frames = OUTPUT_NUM_FRAMES;
+    config.output_sampling_rate = OUTPUT_SAMPLE_RATE;
+    config.spatial_quality = quality;
+    imm_error_code error_code;
+    imm_handle imm_instance = NULL;
+    std::unique_ptr<QualityPolicy> policy;
+    if (adaptive) {
+        QualityPolicySettings policy_settings;
+        policy_settings.start_quality = quality;
+        policy.reset(new QualityPolicy(license_filepath, config, policy_settings));
+        if (!policy->is_ready()) {
+            return 1;
+        }
+        quality = policy->get_quality();  // --quality clamped to the levels the policy has
+    }
+    else {
+        imm_instance = imm_initialize_library(license_filepath, NULL, NULL, config, &error_code);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cout << "imm_initialize_library failed with error code " << error_code << std::endl;
+            return 1;
+        }
+    }
+
+    imm_participant_configuration participant_config;
+    participant_config.input_number_channels = 1;
+    participant_config.input_sampling_rate = talkers.get_sample_rate();
+    participant_config.type = IMM_PARTICIPANT_REGULAR;
+    std::vector<imm_handle> room_instances(num_rooms, NULL);
+    std::vector<int> room_qualities(num_rooms, quality);
+    auto open_room = [&](int room_id) {
+        imm_handle instance = policy ? policy->instance_for_new_room(&room_qualities[room_id]) : imm_instance;
+        imm_error_code code = imm_create_room(instance, room_id);
+        if (code != IMM_ERROR_NONE) {
+            std::cout << "imm_create_room failed for room " << room_id << " with error code " << code << std::endl;
+            return false;
+        }
+        for (int p = 0; p < participants_per_room; p++) {
+            code = imm_add_participant(instance, room_id, p, "participant", participant_config);
+            if (code != IMM_ERROR_NONE) {
+                std::cout << "imm_add_participant failed in room " << room_id << " with error code " << code << std::endl;
+                return false;
+            }
+        }
+        imm_set_all_participants_state(instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
+        imm_set_all_participants_state(instance, room_id, IMM_CONTROL_MIXING_3D_MAX_DISTANCE, 300);
+        seat_on_circle(instance, room_id, 0, participants_per_room);
+        room_instances[room_id] = instance;
+        return true;
+    };
+
+    /* With --adaptive the rooms open one after another while mixing, otherwise all of them now */
+    if (open_seconds < 0) {
+        open_seconds = seconds / 2;
+    }
+    std::vector<long long> open_blocks(num_rooms, 0);
+    for (int room_id = 0; room_id < num_rooms; room_id++) {
+        if (adaptive) {
+            open_blocks[room_id] = (long long)(open_seconds / block_period * room_id / num_rooms);
+        }
+        else if (!open_room(room_id)) {
+            return 1;
+        }
+    }
+
+    /* Deal the rooms out to the workers */
+    std::vector<RoomWorker> workers(num_threads);
+    int num_cpus = (int)allowed_cpus.size();
+    for (int w = 0; w < num_threads; w++) {
+        workers[w].index = w;
+        workers[w].cpu = pin ? allowed_cpus[w % num_cpus] : -1;
+    }
+    for (int room_id = 0; room_id < num_rooms; room_id++) {
+        workers[room_id % num_threads].rooms.push_back(room_id);
+    }
+
+    // Every room shares one schedule, starting once all the workers are up. With --adaptive, the
+    // rooms' deadline alerts drive the spatial_quality of the rooms that open next.
+    DeadlineSettings deadline_settings;
+    deadline_settings.period_seconds = block_period;
+    deadline_settings.alert_overruns = adaptive ? deadline_settings.alert_overruns : 0;
+    DeadlineMonitor deadlines(deadline_settings, [&](const DeadlineAlert& alert) {
+        DeadlineMonitor::log_alert(alert);
+        if (policy) {
+            policy->on_deadline_alert(alert);
+        }
+    });
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    for (int room_id = 0; room_id < num_rooms; room_id++) {
+        deadlines.add_room(room_id);
+        deadlines.start_room(room_id, start);
+    }
+
+    std::atomic<int> workers_running(num_threads);
+    auto run_worker = [&](RoomWorker& worker) {
+        worker.pinned = pin_current_thread(worker.cpu);
+        std::vector<float> output_buffer(2 * OUTPUT_NUM_FRAMES);
+        std::this_thread::sleep_until(start);
+        for (long long b = 0; b < num_blocks; b++) {
+            if (realtime) {
+                std::this_thread::sleep_until(deadlines.release_time(worker.rooms[0], b));
+            }
+            std::chrono::steady_clock::time_point block_start = std::chrono::steady_clock::now();
+            for (int room_id : worker.rooms) {
+                if (room_instances[room_id] == NULL) {
+                    if (b < open_blocks[room_id]) {
+                        continue;
+                    }
+                    if (!open_room(room_id)) {
+                        worker.errors++;
+                        open_blocks[room_id] = num_blocks;
+                        continue;
+                    }
+                }
+                imm_handle instance = room_instances[room_id];
+                for (int p = 0; p < participants_per_room; p++) {
+                    if (imm_input_audio_float(instance, room_id, p, talkers.block(room_id * participants_per_room + p, b), input_frames) != IMM_ERROR_NONE) {
+                        worker.errors++;
+                    }
+                }
+                for (int p = 0; p < participants_per_room; p++) {
+                    if (imm_output_audio_float(instance, room_id, p, output_buffer.data()) != IMM_ERROR_NONE) {
+                        worker.errors++;
+                    }
+                }
+                if (realtime) {
+                    deadlines.block_finished(room_id, b);
+                }
+            }
+            double block_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - block_start).count();
+            worker.busy_seconds += block_seconds;
+            worker.max_block_seconds = std::max(worker.max_block_seconds, block_seconds);
+        }
+        workers_running--;
+    };
+
+    std::cout << (adaptive ? "Opening " : "Mixing ") << num_rooms << " rooms of " << participants_per_room << " participants at spatial_quality " << quality
+              << " on " << num_threads << " threads, " << num_blocks << " blocks" << (realtime ? " in real time" : "") << std::endl;
+    std::vector<std::thread> threads;
+    for (RoomWorker& worker : workers) {
+        threads.emplace_back(run_worker, std::ref(worker));
+    }
+    /* With --adaptive, this thread acts on the alerts the workers raise, so they never wait on it */
+    while (policy && workers_running.load() > 0) {
+        policy->poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    /* Each worker's load is the share of real time it spent mixing */
+    double audio_seconds = num_blocks * block_period;
+    double total_load = 0;
+    long long total_errors = 0;
+    char line[256];
+    snprintf(line, sizeof(line), "%8s %6s %8s %10s %16s %8s", "worker", "cpu", "rooms", "load %", "max block ms", "errors");
+    std::cout << line << std::endl;
+    for (const RoomWorker& worker : workers) {
+        double load = worker.busy_seconds / audio_seconds;
+        total_load += load;
+        total_errors += worker.errors;
+        snprintf(line, sizeof(line), "%8d %6s %8zu %10.1f %16.3f %8lld", worker.index,
+                 worker.pinned ? std::to_string(worker.cpu).c_str() : "-", worker.rooms.size(), 100.0 * load,
+                 1000.0 * worker.max_block_seconds, worker.errors);
+        std::cout << line << std::endl;
+    }
+    if (!adaptive) {
+        // With --adaptive the rooms were not all open the whole time, and not at one spatial_quality
+        snprintf(line, sizeof(line), "Capacity: %.1f rooms of %d participants per core at spatial_quality %d (%.2f cores for %d rooms)",
+                 num_rooms / total_load, participants_per_room, quality, total_load, num_rooms);
+        std::cout << line << std::endl;
+    }
+    if (num_threads > num_cpus) {
+        std::cout << "There are more workers than CPUs, so their load includes time they waited for a CPU" << std::endl;
+    }
+    if (total_errors > 0) {
+        std::cout << total_errors << " imm_input_audio_float or imm_output_audio_float calls failed" << std::endl;
+    }
+    if (realtime) {
+        deadlines.print_report();
+    }
+    if (policy) {
+        policy->print_report();
+    }
+
+    for (int room_id = 0; room_id < num_rooms; room_id++) {
+        if (room_instances[room_id] == NULL) {
+            continue;
+        }
+        for (int p = 0; p < participants_per_room; p++) {
+            imm_remove_participant(room_instances[room_id], room_id, p);
+        }
+        imm_destroy_room(room_instances[room_id], room_id);
+    }
+    if (imm_instance != NULL) {
+        imm_destroy_library(imm_instance);
+    }
+
+    return total_errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,369 @@
+#include "immersitech.h"
+#include "process_memory.h"
+#include "talkers.h"
+#include "thread_affinity.h"
+#include "trajectories.h"
+#include "voice_gate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+#if defined(_WIN32)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+#define OUTPUT_SAMPLE_RATE (48000)
+#define OUTPUT_NUM_FRAMES (480)
+#define SYNTHETIC_SAMPLE_RATE (16000)
+#define SYNTHETIC_VOICES (16)
+#define SYNTHETIC_SECONDS (20)
+
+/*
+
+This command line tool measures how the cost of the 3D mixing grows with the number of
+participants in a room, from a handful up to hundreds, so you can see where a room stops fitting
+in its 10ms block and which spatial_quality keeps it there.
+
+For every spatial_quality and participant count, a library instance is created with one room of
+synthetic talkers, seated at random spots in the room and facing random directions. By default
+the talkers say speech-like noise: syllable-shaped bursts in talk spurts with pauses in between,
+made from a fixed seed so every run hears the same thing. With --voices files they say the
+bundled audio files instead. After the warm-up blocks, every block is timed on a thread pinned to
+one CPU. The resident memory is read once the room is created and again after the participants
+have been added and mixed, so the difference is what the participants cost.
+
+The allocator keeps memory a process has freed, so a configuration measured after another one
+would start from the heap the previous one left behind, and its participants would seem to cost
+next to nothing. Every configuration is therefore measured in a fresh process: the tool runs
+itself once per configuration with --config, which measures that one configuration and prints
+its CSV row, and collects the rows.
+
+With --move, every participant also wanders around the room on a random walk from their seat,
+and their positions are updated at the control rate inside the timed blocks. The time spent
+moving and the number of imm_set_participant_position calls a second show what continuous
+movement costs at each room size, and how many calls the movement threshold saved.
+
+With --vad, every configuration is measured twice, the second time with a voice gate in front of
+each participant's imm_input_audio_float call that skips the call while the participant is
+silent. Comparing the two rows shows the CPU time the gate saves. --talk-ratio sets how much of
+the time the synthetic talkers talk, 0.1 is one of ten people in a meeting.
+
+One CSV row is written per configuration, to stdout or to --csv FILE. Progress is printed to
+stderr.
+
+SYNTAX:
+3d_mixing_scaling <licensefile> [--participants N] ... [--quality N] ... [--blocks N] [--warmup N] [--voices synthetic|files] [--audio-dir DIR] [--csv FILE] [--cpu N] [--move] [--control-rate N] [--move-threshold N] [--vad] [--talk-ratio R]
+
+*/
+
+// Quotes an argument for the shell popen() runs it in
+static std::string shell_quote(const std::string& argument)
+{
+#if defined(_WIN32)
+    return "\"" + argument + "\"";
+#else
+    std::string quoted = "'";
+    for (char c : argument) {
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+#endif
+}
+
+// The path this program was started from, to run it again
+static std::string own_executable(const char* argv0)
+{
+#if defined(__linux__)
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length > 0) {
+        return std::string(path, (size_t)length);
+    }
+#endif
+    return argv0;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: \n3d_mixing_scaling <licensefile> [--participants N] ... [--quality N] ... [--blocks N] [--warmup N] [--voices synthetic|files] [--audio-dir DIR] [--csv FILE] [--cpu N] [--move] [--control-rate N] [--move-threshold N] [--vad] [--talk-ratio R]" << std::endl;
+        std::cerr << "  --participants N  Participants in the room, may be repeated (default 2 5 10 20 50 100 200 500)" << std::endl;
+        std::cerr << "  --quality N       spatial_quality from 1 to 5, may be repeated (default 1 3 5)" << std::endl;
+        std::cerr << "  --blocks N        Timed 10ms blocks per configuration (default 200)" << std::endl;
+        std::cerr << "  --warmup N        Untimed 10ms blocks before timing starts (default 20)" << std::endl;
+        std::cerr << "  --voices KIND     synthetic for speech-like noise, files for the audio files (default synthetic)" << std::endl;
+        std::cerr << "  --audio-dir DIR   Folder with the mono WAV files for --voices files (default: the bundled audio_files)" << std::endl;
+        std::cerr << "  --csv FILE        Write the results to FILE instead of stdout" << std::endl;
+        std::cerr << "  --cpu N           CPU to pin the measuring thread to, -1 to not pin (default 0)" << std::endl;
+        std::cerr << "  --move            Move every participant on a random walk while mixing" << std::endl;
+        std::cerr << "  --control-rate N  Position updates per second while moving (default 20)" << std::endl;
+        std::cerr << "  --move-threshold N  Only update a position once it moved N units or turned N degrees (default 1 and 2)" << std::endl;
+        std::cerr << "  --vad             Measure every configuration again with silent participants' input skipped" << std::endl;
+        std::cerr << "  --talk-ratio R    Share of the time every synthetic talker talks, from 0.01 to 1 (default 0.6)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    std::vector<int> participant_counts;
+    std::vector<int> qualities;
+    int timed_blocks = 200;
+    int warmup_blocks = 20;
+    bool synthetic = true;
+    std::string audio_dir = IMM_AUDIO_FILES_DIR;
+    const char* csv_filepath = NULL;
+    int cpu = 0;
+    bool move = false;
+    TrajectorySettings trajectory_settings;
+    bool vad = false;
+    VoiceGateSettings gate_settings;
+    double talk_ratio = 0.6;
+    int config_quality = 0;         // with --config, the one configuration this process measures
+    int config_participants = 0;
+    int config_gated = 0;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--participants") == 0 && a + 1 < argc) {
+            participant_counts.push_back(std::max(1, atoi(argv[++a])));
+        }
+        else if (strcmp(argv[a], "--quality") == 0 && a + 1 < argc) {
+            qualities.push_back(atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--blocks") == 0 && a + 1 < argc) {
+            timed_blocks = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--warmup") == 0 && a + 1 < argc) {
+            warmup_blocks = std::max(0, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--voices") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "synthetic") == 0) {
+                synthetic = true;
+            }
+            else if (strcmp(argv[a], "files") == 0) {
+                synthetic = false;
+            }
+            else {
+                std::cerr << "--voices must be synthetic or files" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "--audio-dir") == 0 && a + 1 < argc) {
+            audio_dir = argv[++a];
+        }
+        else if (strcmp(argv[a], "--csv") == 0 && a + 1 < argc) {
+            csv_filepath = argv[++a];
+        }
+        else if (strcmp(argv[a], "--cpu") == 0 && a + 1 < argc) {
+            cpu = atoi(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--move") == 0) {
+            move = true;
+        }
+        else if (strcmp(argv[a], "--control-rate") == 0 && a + 1 < argc) {
+            trajectory_settings.control_rate = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--move-threshold") == 0 && a + 1 < argc) {
+            trajectory_settings.min_move = trajectory_settings.min_turn = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--vad") == 0) {
+            vad = true;
+        }
+        else if (strcmp(argv[a], "--talk-ratio") == 0 && a + 1 < argc) {
+            talk_ratio = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--config") == 0 && a + 3 < argc) {
+            config_quality = atoi(argv[++a]);
+            config_participants = std::max(1, atoi(argv[++a]));
+            config_gated = atoi(argv[++a]) != 0;
+        }
+        else {
+            std::cerr << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+    if (participant_counts.empty()) {
+        participant_counts = { 2, 5, 10, 20, 50, 100, 200, 500 };
+    }
+    if (qualities.empty()) {
+        qualities = { 1, 3, 5 };
+    }
+
+    // Without --config, run every configuration in a process of its own and collect the rows
+    if (config_quality == 0) {
+        std::ofstream csv_file;
+        if (csv_filepath != NULL) {
+            csv_file.open(csv_filepath);
+            if (!csv_file) {
+                std::cerr << "Failed to open " << csv_filepath << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& csv = csv_filepath != NULL ? (std::ostream&)csv_file : std::cout;
+        csv << "spatial_quality,participants,blocks,ns_per_block_mean,ns_per_block_p50,ns_per_block_p99,ns_per_block_max,"
+               "ns_per_participant,real_time_factor,rss_base_kb,rss_kb,rss_per_participant_kb,"
+               "ns_moving_per_block,position_updates_per_second,position_updates_skipped_percent,voice_gate,inputs_gated_percent" << std::endl;
+
+        std::string command = shell_quote(own_executable(argv[0]));
+        for (int a = 1; a < argc; a++) {
+            if (strcmp(argv[a], "--csv") == 0 && a + 1 < argc) {
+                a++;
+                continue;
+            }
+            command += " " + shell_quote(argv[a]);
+        }
+        for (int quality : qualities) {
+            for (int num_participants : participant_counts) {
+                for (int gated = 0; gated < (vad ? 2 : 1); gated++) {
+                    std::string config_command = command + " --config " + std::to_string(quality) + " " + std::to_string(num_participants) + " " + std::to_string(gated);
+                    FILE* child = popen(config_command.c_str(), "r");
+                    if (child == NULL) {
+                        std::cerr << "Failed to run " << config_command << std::endl;
+                        return 1;
+                    }
+                    char row[512];
+                    bool have_row = fgets(row, sizeof(row), child) != NULL;
+                    if (pclose(child) != 0 || !have_row) {
+                        std::cerr << "Measuring spatial_quality " << quality << " with " << num_participants << " participants failed" << std::endl;
+                        return 1;
+                    }
+                    csv << row;
+                    csv.flush();
+                }
+            }
+        }
+        return 0;
+    }
+
+    // A few distinct voices are enough, every talker starts them at a different block
+    TalkerAudio talkers;
+    bool loaded = synthetic ? talkers.synthesize(SYNTHETIC_VOICES, SYNTHETIC_SECONDS, SYNTHETIC_SAMPLE_RATE, OUTPUT_NUM_FRAMES, OUTPUT_SAMPLE_RATE, talk_ratio)
+                            : talkers.load(audio_dir, OUTPUT_NUM_FRAMES, OUTPUT_SAMPLE_RATE);
+    if (!loaded) {
+        return 1;
+    }
+    int input_rate = talkers.get_sample_rate();
+    int input_frames = talkers.get_block_frames();
+
+    bool pinned = pin_current_thread(cpu);
+    if (cpu >= 0 && !pinned) {
+        std::cerr << "Could not pin the measuring thread to CPU " << cpu << ", results may be noisier" << std::endl;
+    }
+
+    std::vector<float> output_buffer(2 * OUTPUT_NUM_FRAMES);
+    const double block_period = (double)OUTPUT_NUM_FRAMES / OUTPUT_SAMPLE_RATE;
+    // Measure the one configuration given with --config
+    int quality = config_quality;
+    int num_participants = config_participants;
+    int gated = config_gated;
+    imm_library_configuration config;
+    config.interleaved = false;
+    config.output_number_channels = 2;
+    config.output_number_frames = OUTPUT_NUM_FRAMES;
+    config.output_sampling_rate = OUTPUT_SAMPLE_RATE;
+    config.spatial_quality = quality;
+    imm_error_code error_code;
+    imm_handle imm_instance = imm_initialize_library(license_filepath, NULL, NULL, config, &error_code);
+    if (error_code != IMM_ERROR_NONE) {
+        std::cerr << "imm_initialize_library failed at spatial_quality " << quality << " with error code " << error_code << std::endl;
+        return 1;
+    }
+
+    int room_id = 0;
+    imm_create_room(imm_instance, room_id);
+    size_t rss_base = current_rss_bytes();
+
+    imm_participant_configuration participant_config;
+    participant_config.input_number_channels = 1;
+    participant_config.input_sampling_rate = input_rate;
+    participant_config.type = IMM_PARTICIPANT_REGULAR;
+    for (int p = 0; p < num_participants; p++) {
+        error_code = imm_add_participant(imm_instance, room_id, p, "participant", participant_config);
+        if (error_code != IMM_ERROR_NONE) {
+            std::cerr << "imm_add_participant failed with error code " << error_code << std::endl;
+            return 1;
+        }
+    }
+    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_ENABLE, 1);
+    imm_set_all_participants_state(imm_instance, room_id, IMM_CONTROL_MIXING_3D_MAX_DISTANCE, 300);
+    std::vector<imm_position> seats = seat_randomly(imm_instance, room_id, 0, num_participants, (unsigned int)num_participants);
+    TrajectoryEngine trajectories(imm_instance, trajectory_settings);
+    if (move) {
+        for (int p = 0; p < num_participants; p++) {
+            trajectories.add(room_id, p, Trajectory::random_walk(seats[p], 100, 200, (unsigned int)p + 1));
+        }
+    }
+
+    std::vector<VoiceGate> voice_gates(gated ? num_participants : 0, VoiceGate(gate_settings));
+    long long inputs_gated = 0;
+
+    auto mix_block = [&](int block) {
+        trajectories.update(block * block_period);
+        for (int p = 0; p < num_participants; p++) {
+            if (gated && !voice_gates[p].process(talkers.block(p, block), input_frames)) {
+                inputs_gated++;
+                continue;
+            }
+            imm_input_audio_float(imm_instance, room_id, p, talkers.block(p, block), input_frames);
+        }
+        for (int p = 0; p < num_participants; p++) {
+            imm_output_audio_float(imm_instance, room_id, p, output_buffer.data());
+        }
+    };
+
+    std::cerr << "spatial_quality " << quality << ", " << num_participants << " participants" << (gated ? " with the voice gate" : "") << "..." << std::endl;
+    for (int b = 0; b < warmup_blocks; b++) {
+        mix_block(b);
+    }
+    double moving_seconds = trajectories.get_busy_seconds();
+    long long updates = trajectories.get_updates();
+    long long evaluations = trajectories.get_evaluations();
+    long long skipped = trajectories.get_skipped();
+    inputs_gated = 0;
+    std::vector<double> block_ns(timed_blocks);
+    for (int b = 0; b < timed_blocks; b++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mix_block(warmup_blocks + b);
+        block_ns[b] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    size_t rss = current_rss_bytes();
+    moving_seconds = trajectories.get_busy_seconds() - moving_seconds;
+    updates = trajectories.get_updates() - updates;
+    evaluations = trajectories.get_evaluations() - evaluations;
+    skipped = trajectories.get_skipped() - skipped;
+
+    for (int p = 0; p < num_participants; p++) {
+        imm_remove_participant(imm_instance, room_id, p);
+    }
+    imm_destroy_room(imm_instance, room_id);
+    imm_destroy_library(imm_instance);
+
+    std::sort(block_ns.begin(), block_ns.end());
+    double mean_ns = 0;
+    for (double ns : block_ns) {
+        mean_ns += ns;
+    }
+    mean_ns /= timed_blocks;
+    double rss_growth_kb = rss > rss_base ? (double)(rss - rss_base) / 1024.0 : 0.0;
+
+    char row[512];
+    snprintf(row, sizeof(row), "%d,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.4f,%zu,%zu,%.2f,%.0f,%.1f,%.1f,%d,%.1f", quality, num_participants, timed_blocks,
+             mean_ns, block_ns[timed_blocks / 2], block_ns[std::min(timed_blocks - 1, (int)(timed_blocks * 0.99))],
+             block_ns[timed_blocks - 1], mean_ns / num_participants, mean_ns / (block_period * 1e9), rss_base / 1024,
+             rss / 1024, rss_growth_kb / num_participants, 1e9 * moving_seconds / timed_blocks,
+             updates / (timed_blocks * block_period), evaluations > 0 ? 100.0 * skipped / evaluations : 0.0,
+             gated, 100.0 * inputs_gated / ((double)timed_blocks * num_participants));
+    std::cout << row << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "immersitech.h"
+#include "audiofile.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef IMM_AUDIO_FILES_DIR
+#define IMM_AUDIO_FILES_DIR "../../../audio_files"
+#endif
+
+/*
+
+Voices for the tools that measure rooms full of participants, and a way to seat them.
+
+TalkerAudio loads every mono WAV file of a folder, by default the bundled audio_files. Talker t
+says voice t % number of voices, looped, starting at a different block than the other talkers,
+so no two talkers in a room say the same thing at the same time. Errors are printed to stderr,
+so tools that print JSON on stdout can use it too.
+
+synthesize() makes speech-like voices instead: bursts of low-passed noise shaped into syllables
+at about 4 per second, in talk spurts separated by pauses, over quiet background noise. Talk
+spurts last 1.5 seconds on average, and the pauses are as long as it takes for each voice to
+talk talk_fraction of the time: 0.6 is a lively conversation, 0.1 one of ten people in a
+meeting.
+
+*/
+
+class TalkerAudio
+{
+public:
+    // Loads the voices. A block is output_frames long at the output sample rate.
+    bool load(const std::string& audio_dir, int output_frames, int output_sample_rate)
+    {
+        std::vector<std::string> paths;
+        std::error_code dir_error;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(audio_dir, dir_error)) {
+            if (entry.path().extension() == ".wav") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        if (paths.empty()) {
+            std::cerr << "No WAV files found in " << audio_dir << std::endl;
+            return false;
+        }
+
+        // Every voice needs the same sample rate
+        for (const std::string& path : paths) {
+            AudioFile<float> file;
+            if (file.load(path) == false) {
+                std::cerr << "Failed to load input file " << path << std::endl;
+                return false;
+            }
+            if (sample_rate != 0 && (int)file.getSampleRate() != sample_rate) {
+                std::cerr << "Skipping " << path << ", its sample rate differs from the other files" << std::endl;
+                continue;
+            }
+            sample_rate = file.getSampleRate();
+            voices.push_back(file.samples[0]);
+        }
+        if (((long long)output_frames * sample_rate) % output_sample_rate != 0) {
+            std::cerr << "The audio files' sample rate of " << sample_rate << " Hz does not make whole input blocks" << std::endl;
+            return false;
+        }
+        block_frames = (int)(((long long)output_frames * sample_rate) / output_sample_rate);
+        for (const std::vector<float>& voice : voices) {
+            if ((int)voice.size() < block_frames) {
+                std::cerr << "The audio files are too short to use as voices" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Makes num_voices synthetic voices of the given length, each from its own seed
+    bool synthesize(int num_voices, double seconds, int voice_sample_rate, int output_frames, int output_sample_rate,
+                    double talk_fraction = 0.6)
+    {
+        const double pi = 3.14159265358979323846;
+        sample_rate = voice_sample_rate;
+        if (((long long)output_frames * sample_rate) % output_sample_rate != 0) {
+            std::cerr << "A sample rate of " << sample_rate << " Hz does not make whole input blocks" << std::endl;
+            return false;
+        }
+        block_frames = (int)(((long long)output_frames * sample_rate) / output_sample_rate);
+        size_t length = std::max((size_t)block_frames, (size_t)(seconds * sample_rate));
+        talk_fraction = std::max(0.01, std::min(1.0, talk_fraction));
+        for (int v = 0; v < num_voices; v++) {
+            std::mt19937 random(1234 + v);
+            std::normal_distribution<float> noise(0.0f, 1.0f);
+            const double mean_spurt = 1.5;
+            std::exponential_distribution<double> spurt(1.0 / mean_spurt);                                  // seconds of talking
+            std::exponential_distribution<double> pause(talk_fraction / (mean_spurt * (1.0 - talk_fraction) + 1e-9)); // seconds of silence
+            std::vector<float> voice(length);
+            for (float& sample : voice) {
+                sample = 0.001f * noise(random);    // background noise around -60 dBFS
+            }
+            // Start mid-spurt as often as the voice talks, so short voices are not biased to silence
+            bool talking = std::uniform_real_distribution<double>(0, 1)(random) < talk_fraction;
+            size_t i = talking ? 0 : (size_t)(pause(random) * sample_rate);
+            float low_passed = 0;
+            while (i < length) {
+                size_t end = std::min(length, i + (size_t)(spurt(random) * sample_rate));
+                double syllable_rate = 3.0 + (v % 4) * 0.5;
+                for (size_t start = i; i < end; i++) {
+                    double t = (double)(i - start) / sample_rate;
+                    double envelope = pow(fabs(sin(pi * syllable_rate * t)), 0.7);
+                    low_passed += 0.15f * (noise(random) - low_passed);
+                    voice[i] += (float)(0.4 * envelope) * low_passed;
+                }
+                i += (size_t)(pause(random) * sample_rate);
+            }
+            voices.push_back(std::move(voice));
+        }
+        return true;
+    }
+
+    int get_sample_rate() const { return sample_rate; }
+    int get_block_frames() const { return block_frames; }
+
+    // What talker says during the block
+    const float* block(int talker, long long block) const
+    {
+        const std::vector<float>& voice = voices[talker % voices.size()];
+        size_t num_voice_blocks = voice.size() / block_frames;
+        size_t voice_block = ((size_t)talker * 997 + (size_t)block) % num_voice_blocks;
+        return &voice[voice_block * block_frames];
+    }
+
+private:
+    std::vector<std::vector<float>> voices;
+    int sample_rate = 0;
+    int block_frames = 0;
+};
+
+// Seats participants first_id .. first_id + count - 1 on a circle around the center of the room,
+// facing the center
+inline void seat_on_circle(imm_handle imm_instance, int room_id, int first_id, int count, int radius = 100)
+{
+    const double pi = 3.14159265358979323846;
+    for (int p = 0; p < count; p++) {
+        double angle = 2.0 * pi * p / count;
+        imm_position position = { (int)(radius * cos(angle)), 0, (int)(radius * sin(angle)) };
+        int azimuth = (int)(270 - angle * 180.0 / pi);
+        imm_heading heading = { (azimuth % 360 + 360) % 360, 0 };
+        imm_set_participant_position(imm_instance, room_id, first_id + p, position, heading);
+    }
+}
+
+// Seats participants first_id .. first_id + count - 1 at random spots in a square of the given
+// half-width around the center of the room, facing random directions. The same seed always gives
+// the same seats. Returns the seats, in participant order.
+inline std::vector<imm_position> seat_randomly(imm_handle imm_instance, int room_id, int first_id, int count, unsigned int seed, int extent = 200)
+{
+    std::vector<imm_position> seats;
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> coordinate(-extent, extent);
+    std::uniform_int_distribution<int> azimuth(0, 359);
+    for (int p = 0; p < count; p++) {
+        imm_position position = { coordinate(random), 0, coordinate(random) };
+        imm_heading heading = { azimuth(random), 0 };
+        imm_set_participant_position(imm_instance, room_id, first_id + p, position, heading);
+        seats.push_back(position);
+    }
+    return seats;
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "immersitech.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/*
+
+Moves participants around a room along scripted paths, the way avatars move in a virtual venue.
+
+A Trajectory is a path a participant follows: still, along waypoints, around a circle, or a
+random walk inside a square. It is advanced a step of time at a time and always faces the way it
+is moving. TrajectoryEngine holds the trajectories of a room's participants and, at the control
+rate, sends their new positions and headings with imm_set_participant_position:
+
+    TrajectoryEngine movers(imm_instance);
+    movers.add(room_id, participant_id, Trajectory::circle(center, 100, 10));
+    ...
+    movers.update(seconds_since_start);     // once per block
+
+Every call to the library costs the mixing thread time, so an update is only sent when a
+participant moved at least min_move or turned at least min_turn degrees since the last one it
+was sent. A participant standing still costs nothing, and the engine's report shows how many
+calls were saved that way.
+
+*/
+
+struct TrajectoryPose
+{
+    double x = 0;
+    double y = 0;
+    double z = 0;
+    double azimuth = 0;     // degrees, the same convention as imm_heading
+};
+
+class Trajectory
+{
+public:
+    enum Kind { STILL, WAYPOINTS, CIRCLE, RANDOM_WALK };
+
+    // Stays at position, facing azimuth
+    static Trajectory still(imm_position position, double azimuth)
+    {
+        Trajectory trajectory(STILL);
+        trajectory.pose = to_pose(position);
+        trajectory.pose.azimuth = azimuth;
+        return trajectory;
+    }
+
+    // Walks from point to point at speed units per second, back to the first point when loop is set
+    static Trajectory waypoints(const std::vector<imm_position>& points, double speed, bool loop = true)
+    {
+        Trajectory trajectory(WAYPOINTS);
+        for (const imm_position& point : points) {
+            trajectory.points.push_back(to_pose(point));
+        }
+        trajectory.speed = speed;
+        trajectory.loop = loop;
+        if (!trajectory.points.empty()) {
+            trajectory.pose = trajectory.points[0];
+            trajectory.face(trajectory.points.size() > 1 ? trajectory.points[1] : trajectory.pose);
+        }
+        return trajectory;
+    }
+
+    // Goes around center once every seconds_per_lap, counterclockwise, starting at start_degrees
+    static Trajectory circle(imm_position center, double radius, double seconds_per_lap, double start_degrees = 0)
+    {
+        Trajectory trajectory(CIRCLE);
+        trajectory.center = to_pose(center);
+        trajectory.radius = radius;
+        trajectory.angle = start_degrees * pi / 180.0;
+        trajectory.angular_speed = seconds_per_lap > 0 ? 2.0 * pi / seconds_per_lap : 0;
+        trajectory.place_on_circle();
+        return trajectory;
+    }
+
+    // Wanders at speed units per second, turning a little at random, inside a square of the given
+    // half-width around start. The same seed always takes the same path.
+    static Trajectory random_walk(imm_position start, double speed, double extent, unsigned int seed)
+    {
+        Trajectory trajectory(RANDOM_WALK);
+        trajectory.center = to_pose(start);
+        trajectory.pose = trajectory.center;
+        trajectory.speed = speed;
+        trajectory.extent = extent;
+        trajectory.random.seed(seed);
+        trajectory.direction = std::uniform_real_distribution<double>(0, 2.0 * pi)(trajectory.random);
+        trajectory.pose.azimuth = azimuth_of(cos(trajectory.direction), sin(trajectory.direction));
+        return trajectory;
+    }
+
+    Kind get_kind() const { return kind; }
+    const TrajectoryPose& get_pose() const { return pose; }
+
+    // Moves seconds further along the path and returns where it is now
+    const TrajectoryPose& advance(double seconds)
+    {
+        switch (kind) {
+        case STILL:
+            break;
+        case WAYPOINTS:
+            advance_waypoints(speed * seconds);
+            break;
+        case CIRCLE:
+            angle += angular_speed * seconds;
+            angle = fmod(angle, 2.0 * pi);
+            place_on_circle();
+            break;
+        case RANDOM_WALK:
+            advance_random_walk(seconds);
+            break;
+        }
+        return pose;
+    }
+
+private:
+    static constexpr double pi = 3.14159265358979323846;
+
+    explicit Trajectory(Kind kind) : kind(kind) {}
+
+    static TrajectoryPose to_pose(imm_position position)
+    {
+        TrajectoryPose pose;
+        pose.x = position.x;
+        pose.y = position.y;
+        pose.z = position.z;
+        return pose;
+    }
+
+    // The azimuth of someone facing along (dx, dz), as seat_on_circle() uses it
+    static double azimuth_of(double dx, double dz)
+    {
+        double degrees = 90.0 - atan2(dz, dx) * 180.0 / pi;
+        return fmod(fmod(degrees, 360.0) + 360.0, 360.0);
+    }
+
+    void face(const TrajectoryPose& target)
+    {
+        double dx = target.x - pose.x;
+        double dz = target.z - pose.z;
+        if (dx != 0 || dz != 0) {
+            pose.azimuth = azimuth_of(dx, dz);
+        }
+    }
+
+    void place_on_circle()
+    {
+        pose.x = center.x + radius * cos(angle);
+        pose.y = center.y;
+        pose.z = center.z + radius * sin(angle);
+        pose.azimuth = azimuth_of(-sin(angle), cos(angle));
+    }
+
+    void advance_waypoints(double distance)
+    {
+        while (distance > 0 && next_point < points.size()) {
+            const TrajectoryPose& target = points[next_point];
+            double dx = target.x - pose.x;
+            double dy = target.y - pose.y;
+            double dz = target.z - pose.z;
+            double remaining = sqrt(dx * dx + dy * dy + dz * dz);
+            face(target);
+            if (remaining > distance) {
+                pose.x += dx * distance / remaining;
+                pose.y += dy * distance / remaining;
+                pose.z += dz * distance / remaining;
+                return;
+            }
+            pose.x = target.x;
+            pose.y = target.y;
+            pose.z = target.z;
+            distance -= remaining;
+            next_point++;
+            if (next_point == points.size() && loop && points.size() > 1) {
+                next_point = 0;
+            }
+            if (remaining == 0 && next_point == 0) {
+                return;     // every point is the same, there is nowhere to go
+            }
+        }
+    }
+
+    void advance_random_walk(double seconds)
+    {
+        // The direction drifts by up to about 90 degrees a second
+        direction += std::normal_distribution<double>(0.0, 1.5 * sqrt(seconds))(random);
+        double step = speed * seconds;
+        double x = pose.x + step * cos(direction);
+        double z = pose.z + step * sin(direction);
+        // Turn back at the edges of the square
+        if (fabs(x - center.x) > extent) {
+            direction = pi - direction;
+            x = pose.x + step * cos(direction);
+        }
+        if (fabs(z - center.z) > extent) {
+            direction = -direction;
+            z = pose.z + step * sin(direction);
+        }
+        pose.x = x;
+        pose.z = z;
+        pose.azimuth = azimuth_of(cos(direction), sin(direction));
+    }
+
+    Kind kind;
+    TrajectoryPose pose;
+    std::vector<TrajectoryPose> points;
+    size_t next_point = 1;
+    bool loop = true;
+    TrajectoryPose center;
+    double radius = 0;
+    double angle = 0;
+    double angular_speed = 0;
+    double speed = 0;
+    double extent = 0;
+    double direction = 0;
+    std::mt19937 random;
+};
+
+struct TrajectorySettings
+{
+    double control_rate = 20;   // position updates per second
+    double min_move = 1;        // distance a participant must move before its position is sent again
+    double min_turn = 2;        // degrees a participant must turn before its heading is sent again
+};
+
+class TrajectoryEngine
+{
+public:
+    TrajectoryEngine(imm_handle imm_instance, const TrajectorySettings& settings = TrajectorySettings())
+        : imm_instance(imm_instance), settings(settings)
+    {
+        next_tick = settings.control_rate > 0 ? 1.0 / settings.control_rate : 0;
+    }
+
+    // Moves the participant along trajectory from now on, starting with its position right away
+    void add(int room_id, int participant_id, const Trajectory& trajectory)
+    {
+        Mover mover{ room_id, participant_id, trajectory, trajectory.get_pose() };
+        send(mover, to_position(trajectory.get_pose()), to_heading(trajectory.get_pose()));
+        movers.push_back(mover);
+    }
+
+    // Stops moving the participant, for when it leaves the room
+    void remove(int room_id, int participant_id)
+    {
+        movers.erase(std::remove_if(movers.begin(), movers.end(),
+                                    [&](const Mover& mover) { return mover.room_id == room_id && mover.participant_id == participant_id; }),
+                     movers.end());
+    }
+
+    // Call as often as you like with the seconds since mixing started, e.g. once per block. Every
+    // 1 / control_rate seconds, the trajectories are advanced and the positions that changed
+    // enough are sent. Returns the number of imm_set_participant_position calls made.
+    int update(double seconds)
+    {
+        if (seconds < next_tick) {
+            return 0;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double step = seconds - last_tick;
+        last_tick = seconds;
+        double period = settings.control_rate > 0 ? 1.0 / settings.control_rate : 0;
+        next_tick += period;
+        if (next_tick <= seconds) {
+            next_tick = seconds + period;   // fell behind, skip the missed ticks rather than catch up
+        }
+
+        int calls = 0;
+        for (Mover& mover : movers) {
+            const TrajectoryPose& pose = mover.trajectory.advance(step);
+            evaluations++;
+            double dx = pose.x - mover.sent_pose.x;
+            double dy = pose.y - mover.sent_pose.y;
+            double dz = pose.z - mover.sent_pose.z;
+            double turn = fabs(pose.azimuth - mover.sent_pose.azimuth);
+            turn = std::min(turn, 360.0 - turn);
+            imm_position position = to_position(pose);
+            imm_heading heading = to_heading(pose);
+            bool moved = dx * dx + dy * dy + dz * dz >= settings.min_move * settings.min_move || turn >= settings.min_turn;
+            bool changed = position.x != mover.sent_position.x || position.y != mover.sent_position.y ||
+                           position.z != mover.sent_position.z || heading.azimuth_heading != mover.sent_heading.azimuth_heading;
+            if (!moved || !changed) {
+                skipped++;
+                continue;
+            }
+            send(mover, position, heading);
+            calls++;
+        }
+        ticks++;
+        busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return calls;
+    }
+
+    size_t get_num_movers() const { return movers.size(); }
+    long long get_ticks() const { return ticks; }
+    long long get_evaluations() const { return evaluations; }
+    long long get_updates() const { return updates; }
+    long long get_skipped() const { return skipped; }
+    long long get_errors() const { return errors; }
+    double get_busy_seconds() const { return busy_seconds; }
+
+    void print_report() const
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "Moved %zu participants at %.0f updates per second: %lld position updates sent, %lld skipped (%.1f%%)",
+                 movers.size(), settings.control_rate, updates, skipped,
+                 evaluations > 0 ? 100.0 * skipped / evaluations : 0.0);
+        std::cout << line << std::endl;
+        snprintf(line, sizeof(line), "Moving took %.3f ms in all, %.1f us per control tick over %lld ticks",
+                 1000.0 * busy_seconds, ticks > 0 ? 1e6 * busy_seconds / ticks : 0.0, ticks);
+        std::cout << line << std::endl;
+        if (errors > 0) {
+            std::cout << errors << " imm_set_participant_position calls failed" << std::endl;
+        }
+    }
+
+private:
+    struct Mover
+    {
+        int room_id;
+        int participant_id;
+        Trajectory trajectory;
+        TrajectoryPose sent_pose;
+        imm_position sent_position = { 0, 0, 0 };
+        imm_heading sent_heading = { 0, 0 };
+    };
+
+    static imm_position to_position(const TrajectoryPose& pose)
+    {
+        return imm_position{ (int)lround(pose.x), (int)lround(pose.y), (int)lround(pose.z) };
+    }
+
+    static imm_heading to_heading(const TrajectoryPose& pose)
+    {
+        return imm_heading{ (int)lround(pose.azimuth) % 360, 0 };
+    }
+
+    void send(Mover& mover, imm_position position, imm_heading heading)
+    {
+        if (imm_set_participant_position(imm_instance, mover.room_id, mover.participant_id, position, heading) != IMM_ERROR_NONE) {
+            errors++;
+        }
+        mover.sent_position = position;
+        mover.sent_heading = heading;
+        mover.sent_pose = mover.trajectory.get_pose();
+        updates++;
+    }
+
+    imm_handle imm_instance;
+    TrajectorySettings settings;
+    std::vector<Mover> movers;
+    double next_tick = 0;
+    double last_tick = 0;
+    long long ticks = 0;
+    long long evaluations = 0;
+    long long updates = 0;
+    long long skipped = 0;
+    long long errors = 0;
+    double busy_seconds = 0;
+};
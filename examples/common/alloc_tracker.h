@@ -0,0 +1,401 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <errno.h>
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+/*
+
+Heap allocation tracking for the processing loops.
+
+Real-time audio threads must not allocate: malloc can take locks and page in memory, and either
+can make a 10ms buffer late. The tracker counts every allocation per thread and per named scope,
+and reports allocations made inside a scope that has reached its steady state.
+
+    int process_scope = AllocTracker::register_scope("imm_cv_process");
+    AllocTracker::enable_checks(true);
+    ...
+    for (int block = 0; ...; block++) {
+        AllocScope scope(process_scope, block >= warmup_blocks);
+        imm_cv_process(...);
+    }
+    ...
+    AllocTracker::print_report();
+    if (AllocTracker::get_violations() > 0) { fail the run }
+
+Warm-up blocks are counted but allowed to allocate, since libraries commonly size their buffers
+on first use. Each violation in the steady state logs the scope, the size and a stack trace to
+stderr, or aborts the program with ALLOC_POLICY_ABORT so it stops in the debugger.
+
+The allocation hooks are compiled into the one translation unit that defines
+IMM_ALLOC_TRACKER_IMPLEMENTATION before including this header. With glibc they interpose malloc
+and friends, which also covers operator new and allocations made inside the Immersitech
+libraries. Elsewhere only operator new is replaced. The hooks are left out of sanitizer builds,
+which install their own allocator.
+
+*/
+
+enum AllocPolicy
+{
+    ALLOC_POLICY_LOG = 0,   // log a stack trace for the first violations and carry on
+    ALLOC_POLICY_ABORT      // abort on the first violation
+};
+
+class AllocTracker
+{
+public:
+    static const int max_scopes = 32;
+    static const int max_threads = 64;  // further threads share one "other threads" entry
+    static const int max_logged = 10;   // stack traces logged before going quiet
+
+    // Registers a named scope and returns its id. Call this before processing starts.
+    static int register_scope(const char* name)
+    {
+        ThreadState& state = thread_state();
+        bool busy = state.busy;
+        state.busy = true;
+        int id = -1;
+        for (int i = 0; i < num_scopes.load(); i++) {
+            if (strcmp(scopes[i].name, name) == 0) {
+                id = i;
+            }
+        }
+        if (id < 0 && num_scopes.load() < max_scopes) {
+            id = num_scopes.load();
+            scopes[id].name = name;
+            num_scopes++;
+        }
+        state.busy = busy;
+        return id;
+    }
+
+    // Names the calling thread in the report
+    static void name_thread(const char* name)
+    {
+        threads[thread_slot()].name = name;
+    }
+
+    // Steady-state checks are off until this is called, only counting happens
+    static void enable_checks(bool enable)
+    {
+#if defined(__GLIBC__)
+        // backtrace() loads libgcc on its first call, do that now rather than while reporting
+        void* frames[1];
+        backtrace(frames, 1);
+#endif
+        checks_enabled = enable;
+    }
+
+    static void set_policy(AllocPolicy new_policy) { policy = new_policy; }
+
+    // Set by the hooks, so the report can tell a quiet loop from a build without hooks
+    static void mark_hooks_installed() { hooks_active = true; }
+    static bool hooks_installed() { return hooks_active.load(); }
+    static uint64_t get_violations() { return violations.load(); }
+
+    // Called by the allocation hooks
+    static void on_allocation(size_t bytes)
+    {
+        ThreadState& state = thread_state();
+        if (state.busy) {
+            return;
+        }
+        threads[thread_slot()].counts.add(bytes);
+        if (state.scope < 0) {
+            return;
+        }
+        scopes[state.scope].counts.add(bytes);
+        if (state.steady && checks_enabled.load(std::memory_order_relaxed)) {
+            scopes[state.scope].steady_counts.add(bytes);
+            report_violation(state.scope, bytes);
+        }
+    }
+
+    static void print_report()
+    {
+        ThreadState& state = thread_state();
+        bool busy = state.busy;
+        state.busy = true;
+        if (!hooks_installed()) {
+            std::cout << "Allocation hooks are not installed in this build, no allocations were counted" << std::endl;
+        }
+        char line[256];
+        snprintf(line, sizeof(line), "%-24s %14s %14s %18s %18s", "scope", "allocations", "bytes", "steady allocations", "steady bytes");
+        std::cout << line << std::endl;
+        for (int i = 0; i < num_scopes.load(); i++) {
+            const Scope& scope = scopes[i];
+            snprintf(line, sizeof(line), "%-24s %14llu %14llu %18llu %18llu", scope.name,
+                     (unsigned long long)scope.counts.allocations.load(), (unsigned long long)scope.counts.bytes.load(),
+                     (unsigned long long)scope.steady_counts.allocations.load(), (unsigned long long)scope.steady_counts.bytes.load());
+            std::cout << line << std::endl;
+        }
+        snprintf(line, sizeof(line), "%-24s %14s %14s", "thread", "allocations", "bytes");
+        std::cout << line << std::endl;
+        int used = std::min(num_threads.load(), max_threads + 1);
+        for (int i = 0; i < used; i++) {
+            const Thread& thread = threads[i];
+            char name[32];
+            if (thread.name != NULL) {
+                snprintf(name, sizeof(name), "%s", thread.name);
+            }
+            else if (i == max_threads) {
+                snprintf(name, sizeof(name), "other threads");
+            }
+            else {
+                snprintf(name, sizeof(name), "thread %d", i);
+            }
+            snprintf(line, sizeof(line), "%-24s %14llu %14llu", name,
+                     (unsigned long long)thread.counts.allocations.load(), (unsigned long long)thread.counts.bytes.load());
+            std::cout << line << std::endl;
+        }
+        if (violations.load() > 0) {
+            std::cout << violations.load() << " allocations happened in the steady state of a real-time scope" << std::endl;
+        }
+        state.busy = busy;
+    }
+
+private:
+    friend class AllocScope;
+
+    struct Counts
+    {
+        std::atomic<uint64_t> allocations{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+
+        void add(size_t size)
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    };
+
+    struct Scope
+    {
+        const char* name = NULL;
+        Counts counts;
+        Counts steady_counts;
+    };
+
+    struct Thread
+    {
+        const char* name = NULL;
+        Counts counts;
+    };
+
+    // Plain data only, so reading it from inside malloc can never allocate
+    struct ThreadState
+    {
+        int slot = -1;
+        int scope = -1;
+        bool steady = false;
+        bool busy = false;  // set while the tracker itself runs, so it is not counted
+    };
+
+    static ThreadState& thread_state()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    static int thread_slot()
+    {
+        ThreadState& state = thread_state();
+        if (state.slot < 0) {
+            state.slot = std::min(num_threads.fetch_add(1), (int)max_threads);
+        }
+        return state.slot;
+    }
+
+    static void report_violation(int scope, size_t bytes)
+    {
+        uint64_t count = ++violations;
+        if (policy.load() == ALLOC_POLICY_LOG && count > (uint64_t)max_logged) {
+            return;
+        }
+        ThreadState& state = thread_state();
+        state.busy = true;
+        char message[256];
+        int length = snprintf(message, sizeof(message), "Allocation of %llu bytes in the steady state of scope %s\n",
+                              (unsigned long long)bytes, scopes[scope].name);
+#if defined(__GLIBC__)
+        // Written straight to the file descriptor, stdio could allocate
+        if (write(STDERR_FILENO, message, std::min(length, (int)sizeof(message) - 1)) > 0) {
+            void* frames[32];
+            backtrace_symbols_fd(frames, backtrace(frames, 32), STDERR_FILENO);
+        }
+#else
+        fputs(message, stderr);
+        (void)length;
+#endif
+        if (policy.load() == ALLOC_POLICY_ABORT) {
+            abort();
+        }
+        state.busy = false;
+    }
+
+    static Scope scopes[max_scopes];
+    static std::atomic<int> num_scopes;
+    static Thread threads[max_threads + 1];
+    static std::atomic<int> num_threads;
+    static std::atomic<bool> checks_enabled;
+    static std::atomic<int> policy;
+    static std::atomic<uint64_t> violations;
+    static std::atomic<bool> hooks_active;
+};
+
+// All constant-initialized, so they are usable by allocations made before main()
+inline AllocTracker::Scope AllocTracker::scopes[AllocTracker::max_scopes];
+inline std::atomic<int> AllocTracker::num_scopes{ 0 };
+inline AllocTracker::Thread AllocTracker::threads[AllocTracker::max_threads + 1];
+inline std::atomic<int> AllocTracker::num_threads{ 0 };
+inline std::atomic<bool> AllocTracker::checks_enabled{ false };
+inline std::atomic<int> AllocTracker::policy{ ALLOC_POLICY_LOG };
+inline std::atomic<uint64_t> AllocTracker::violations{ 0 };
+inline std::atomic<bool> AllocTracker::hooks_active{ false };
+
+// Marks the calling thread as inside a scope until destruction. Scopes nest.
+class AllocScope
+{
+public:
+    AllocScope(int scope, bool steady_state = true)
+    {
+        AllocTracker::ThreadState& state = AllocTracker::thread_state();
+        previous_scope = state.scope;
+        previous_steady = state.steady;
+        state.scope = scope;
+        state.steady = scope >= 0 && steady_state;
+    }
+
+    ~AllocScope()
+    {
+        AllocTracker::ThreadState& state = AllocTracker::thread_state();
+        state.scope = previous_scope;
+        state.steady = previous_steady;
+    }
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+private:
+    int previous_scope;
+    bool previous_steady;
+};
+
+#if defined(IMM_ALLOC_TRACKER_IMPLEMENTATION) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+
+static struct AllocTrackerHooks
+{
+    AllocTrackerHooks() { AllocTracker::mark_hooks_installed(); }
+} alloc_tracker_hooks;
+
+#if defined(__GLIBC__)
+
+// glibc exports its allocator under these names as well, so the interposed functions can forward to it
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(size_t size) noexcept
+{
+    AllocTracker::on_allocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    AllocTracker::on_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) noexcept
+{
+    AllocTracker::on_allocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+    AllocTracker::on_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    AllocTracker::on_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    AllocTracker::on_allocation(size);
+    void* result = __libc_memalign(alignment, size);
+    if (result == NULL) {
+        return ENOMEM;
+    }
+    *pointer = result;
+    return 0;
+}
+
+void free(void* pointer) noexcept
+{
+    __libc_free(pointer);
+}
+}
+
+#else
+
+// Without glibc only C++ allocations are seen
+void* operator new(size_t size)
+{
+    AllocTracker::on_allocation(size);
+    void* pointer = malloc(size > 0 ? size : 1);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    AllocTracker::on_allocation(size);
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+
+#endif
+
+#endif
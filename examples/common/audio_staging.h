@@ -0,0 +1,67 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMM_STAGING_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMM_STAGING_NEON
+#endif
+
+/*
+
+Converts stereo blocks between two per-channel arrays and the interleaved layout (L R L R ...)
+the Immersitech libraries take and return when imm_library_configuration::interleaved is set.
+InputReader interleaves the blocks it reads and OutputWriter deinterleaves the blocks it writes.
+
+Both use SSE2 or NEON where the compiler targets them, and go one sample at a time for the
+frames left over and on other targets.
+
+*/
+
+// out = L0 R0 L1 R1 ...
+inline void interleave_stereo(const float* left, const float* right, float* out, int frames)
+{
+    int i = 0;
+#if defined(IMM_STAGING_SSE2)
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+#elif defined(IMM_STAGING_NEON)
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = { { vld1q_f32(left + i), vld1q_f32(right + i) } };
+        vst2q_f32(out + 2 * i, lr);
+    }
+#endif
+    for (; i < frames; i++) {
+        out[2 * i] = left[i];
+        out[2 * i + 1] = right[i];
+    }
+}
+
+// The inverse of interleave_stereo()
+inline void deinterleave_stereo(const float* in, float* left, float* right, int frames)
+{
+    int i = 0;
+#if defined(IMM_STAGING_SSE2)
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(in + 2 * i);        // L0 R0 L1 R1
+        __m128 b = _mm_loadu_ps(in + 2 * i + 4);    // L2 R2 L3 R3
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(IMM_STAGING_NEON)
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = vld2q_f32(in + 2 * i);
+        vst1q_f32(left + i, lr.val[0]);
+        vst1q_f32(right + i, lr.val[1]);
+    }
+#endif
+    for (; i < frames; i++) {
+        left[i] = in[2 * i];
+        right[i] = in[2 * i + 1];
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <vector>
+
+/*
+
+Checks every block of a real-time loop against a wall-clock schedule.
+
+A real-time host hands the mixer a block every period (10ms for 480 frames at 48kHz) and needs
+it back before the next one is due. The monitor anchors a schedule for each room when the room
+starts, after which block k is released at start + k * period and due at start + (k + 1) * period.
+When a block finishes after it was due, it is an overrun, and the time it was late by goes into a
+per-room distribution:
+
+    DeadlineMonitor monitor(settings);
+    monitor.add_room(room_id);
+    monitor.start_room(room_id);
+    for (long long block = 0; ...; block++) {
+        ...mix the block...
+        monitor.block_finished(room_id, block);
+    }
+    monitor.print_report();
+
+When alert_overruns blocks of a room overrun within its last alert_window blocks, the alert
+callback is called, by default logging a line. It is called again, with raised set to false,
+once a whole window has passed without an overrun.
+
+A loop reading from files runs ahead of the schedule whenever it is faster than real time, and
+the slack it builds up hides a slow block. Waiting until release_time() before each block paces
+the loop like a real-time callback. Rooms are added before processing starts, after which
+block_finished() does not allocate. Each room must only be driven by one thread at a time.
+
+*/
+
+struct DeadlineSettings
+{
+    double period_seconds = 0.01;           // real-time period of one block
+    double late_threshold_seconds = 0;      // blocks later than this past their deadline are overruns
+    int alert_overruns = 5;                 // overruns within the window that raise an alert, 0 never alerts
+    int alert_window = 100;                 // blocks
+};
+
+struct DeadlineAlert
+{
+    int room;
+    long long block;                // block that raised or cleared the alert
+    int overruns_in_window;
+    int window_blocks;
+    double late_by_seconds;         // how late that block was, negative when it was early
+    bool raised;                    // true when the alert is raised, false when it clears
+};
+
+class DeadlineMonitor
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(const DeadlineAlert&)> AlertCallback;
+
+    // Upper bounds of the late-by distribution, in milliseconds. The last bucket has no upper bound.
+    static const int NUM_LATE_BUCKETS = 10;
+    static const double* late_bucket_ms()
+    {
+        static const double bounds[NUM_LATE_BUCKETS - 1] = { 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50 };
+        return bounds;
+    }
+
+    explicit DeadlineMonitor(DeadlineSettings settings, AlertCallback callback = AlertCallback())
+        : settings(settings), callback(callback)
+    {
+        if (!this->callback) {
+            this->callback = [](const DeadlineAlert& alert) { log_alert(alert); };
+        }
+        period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.period_seconds));
+        late_threshold = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.late_threshold_seconds));
+    }
+
+    void add_room(int room)
+    {
+        Room& state = rooms[room];
+        state.window.assign(std::max(1, settings.alert_window), 0);
+    }
+
+    // Anchors the room's schedule, block 0 is released now
+    void start_room(int room)
+    {
+        start_room(room, Clock::now());
+    }
+
+    void start_room(int room, Clock::time_point start)
+    {
+        rooms[room].start = start;
+    }
+
+    Clock::time_point release_time(int room, long long block) const
+    {
+        return rooms.at(room).start + period * block;
+    }
+
+    Clock::time_point deadline(int room, long long block) const
+    {
+        return release_time(room, block + 1);
+    }
+
+    // Records that the block is done, returns how late it was in seconds, negative when it was early
+    double block_finished(int room, long long block)
+    {
+        Clock::time_point now = Clock::now();
+        Room& state = rooms.at(room);
+        Clock::duration late_by = now - (state.start + period * (block + 1));
+        double late_by_seconds = std::chrono::duration<double>(late_by).count();
+
+        state.blocks++;
+        bool overrun = late_by > late_threshold;
+        if (overrun) {
+            state.overruns++;
+            state.total_late_seconds += late_by_seconds;
+            state.max_late_seconds = std::max(state.max_late_seconds, late_by_seconds);
+            state.late_buckets[late_bucket(late_by_seconds * 1000.0)]++;
+        }
+
+        // Slide the window of recent blocks along
+        char& slot = state.window[state.window_index];
+        state.overruns_in_window += (overrun ? 1 : 0) - slot;
+        slot = overrun ? 1 : 0;
+        state.window_index = (state.window_index + 1) % state.window.size();
+        state.blocks_since_overrun = overrun ? 0 : state.blocks_since_overrun + 1;
+
+        if (settings.alert_overruns > 0) {
+            if (!state.alerting && state.overruns_in_window >= settings.alert_overruns) {
+                state.alerting = true;
+                state.alerts++;
+                callback({ room, block, state.overruns_in_window, (int)state.window.size(), late_by_seconds, true });
+            }
+            else if (state.alerting && state.blocks_since_overrun >= (long long)state.window.size()) {
+                state.alerting = false;
+                callback({ room, block, state.overruns_in_window, (int)state.window.size(), late_by_seconds, false });
+            }
+        }
+        return late_by_seconds;
+    }
+
+    long long get_overruns(int room) const
+    {
+        return rooms.at(room).overruns;
+    }
+
+    long long get_total_overruns() const
+    {
+        long long total = 0;
+        for (const auto& entry : rooms) {
+            total += entry.second.overruns;
+        }
+        return total;
+    }
+
+    void print_report() const
+    {
+        std::cout << "Block deadlines (" << settings.period_seconds * 1000.0 << " ms period)" << std::endl;
+        char line[256];
+        snprintf(line, sizeof(line), "%8s %12s %12s %10s %14s %14s %8s", "room", "blocks", "overruns", "overrun %", "mean late ms", "max late ms", "alerts");
+        std::cout << line << std::endl;
+        for (const auto& entry : rooms) {
+            const Room& state = entry.second;
+            snprintf(line, sizeof(line), "%8d %12lld %12lld %10.2f %14.3f %14.3f %8lld", entry.first, state.blocks, state.overruns,
+                     state.blocks > 0 ? 100.0 * state.overruns / state.blocks : 0.0,
+                     state.overruns > 0 ? 1000.0 * state.total_late_seconds / state.overruns : 0.0,
+                     1000.0 * state.max_late_seconds, state.alerts);
+            std::cout << line << std::endl;
+        }
+
+        // How late the overruns were, over all rooms
+        long long total = get_total_overruns();
+        if (total == 0) {
+            return;
+        }
+        std::cout << "Overruns by how late they were" << std::endl;
+        for (int b = 0; b < NUM_LATE_BUCKETS; b++) {
+            long long count = 0;
+            for (const auto& entry : rooms) {
+                count += entry.second.late_buckets[b];
+            }
+            if (b < NUM_LATE_BUCKETS - 1) {
+                snprintf(line, sizeof(line), "  <= %6.2f ms %12lld %8.2f%%", late_bucket_ms()[b], count, 100.0 * count / total);
+            }
+            else {
+                snprintf(line, sizeof(line), "   > %6.2f ms %12lld %8.2f%%", late_bucket_ms()[b - 1], count, 100.0 * count / total);
+            }
+            std::cout << line << std::endl;
+        }
+    }
+
+    static void log_alert(const DeadlineAlert& alert)
+    {
+        char line[256];
+        if (alert.raised) {
+            snprintf(line, sizeof(line), "DEADLINE ALERT room %d: %d overruns in the last %d blocks, block %lld finished %.3f ms late",
+                     alert.room, alert.overruns_in_window, alert.window_blocks, alert.block, alert.late_by_seconds * 1000.0);
+        }
+        else {
+            snprintf(line, sizeof(line), "DEADLINE RECOVERED room %d: no overruns in the %d blocks up to block %lld",
+                     alert.room, alert.window_blocks, alert.block);
+        }
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Room
+    {
+        Clock::time_point start = Clock::now();
+        long long blocks = 0;
+        long long overruns = 0;
+        long long alerts = 0;
+        double total_late_seconds = 0;
+        double max_late_seconds = 0;
+        long long late_buckets[NUM_LATE_BUCKETS] = {};
+        std::vector<char> window;       // 1 for each of the recent blocks that overran
+        size_t window_index = 0;
+        int overruns_in_window = 0;
+        long long blocks_since_overrun = 0;
+        bool alerting = false;
+    };
+
+    static int late_bucket(double late_ms)
+    {
+        int b = 0;
+        while (b < NUM_LATE_BUCKETS - 1 && late_ms > late_bucket_ms()[b]) {
+            b++;
+        }
+        return b;
+    }
+
+    DeadlineSettings settings;
+    AlertCallback callback;
+    Clock::duration period;
+    Clock::duration late_threshold;
+    std::map<int, Room> rooms;
+};
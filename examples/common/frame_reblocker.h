@@ -0,0 +1,152 @@
+#pragma once
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+/*
+
+Adapter between a host that delivers audio in blocks of any size and a processor that only
+accepts fixed-size frames (ClearVoice always wants exactly 10ms).
+
+    FrameReblocker reblocker(sample_rate / 100, host_block_size);
+    reblocker.process(in, out, n, [&](const float* frame_in, float* frame_out) {
+        imm_cv_process(handle, frame_in, frame_out, &metadata);
+    });
+    ...
+    reblocker.flush(tail, process);
+
+When the host block size is a multiple of the frame size the adapter is transparent: frames
+are processed straight from the host's input buffer into the host's output buffer with no
+copies and no added latency. Only the last block of a stream may then be shorter; its
+partial frame is zero-padded, processed and trimmed immediately.
+
+Otherwise the output is delayed by get_latency() samples (one frame). Input frames are still
+taken straight from the host buffer whenever a whole frame is available there. At the end
+of the stream flush() zero-pads the last partial frame and writes the final get_latency()
+samples of output, so a file processed this way can be trimmed back to its exact length.
+
+*/
+class FrameReblocker
+{
+public:
+    FrameReblocker(int frame_size, int host_block_size)
+        : frame_size(frame_size),
+          latency(host_block_size % frame_size == 0 ? 0 : frame_size),
+          pending(frame_size),
+          scratch(frame_size),
+          fifo(2 * frame_size)
+    {
+        // The delayed output starts with one frame of silence
+        fifo_count = latency;
+    }
+
+    int get_frame_size() const { return frame_size; }
+    int get_latency() const { return latency; }
+
+    // Process one host block. out receives num_samples samples of output, delayed by get_latency().
+    template <class Process>
+    void process(const float* in, float* out, int num_samples, Process&& process_frame)
+    {
+        if (latency == 0) {
+            process_aligned(in, out, num_samples, process_frame);
+            return;
+        }
+
+        int pos = 0;
+        while (pos < num_samples) {
+            const float* frame_in = NULL;
+            int taken;
+            if (pending_count == 0 && num_samples - pos >= frame_size) {
+                // A whole frame is available in the host buffer, use it in place
+                frame_in = in + pos;
+                taken = frame_size;
+            }
+            else {
+                taken = std::min(frame_size - pending_count, num_samples - pos);
+                memcpy(&pending[pending_count], in + pos, taken * sizeof(float));
+                pending_count += taken;
+                if (pending_count == frame_size) {
+                    frame_in = pending.data();
+                    pending_count = 0;
+                }
+            }
+
+            if (frame_in != NULL) {
+                process_frame(frame_in, scratch.data());
+                push_output(scratch.data(), frame_size);
+            }
+            pop_output(out + pos, taken);
+            pos += taken;
+        }
+    }
+
+    // End of stream. Writes the last get_latency() samples of output to out and returns how many were written.
+    template <class Process>
+    int flush(float* out, Process&& process_frame)
+    {
+        if (latency == 0) {
+            return 0;
+        }
+        if (pending_count > 0) {
+            std::fill(pending.begin() + pending_count, pending.end(), 0.0f);
+            process_frame(pending.data(), scratch.data());
+            push_output(scratch.data(), pending_count);
+            pending_count = 0;
+        }
+        int count = fifo_count;
+        pop_output(out, count);
+        return count;
+    }
+
+private:
+    template <class Process>
+    void process_aligned(const float* in, float* out, int num_samples, Process& process_frame)
+    {
+        int pos = 0;
+        for (; pos + frame_size <= num_samples; pos += frame_size) {
+            process_frame(in + pos, out + pos);
+        }
+
+        // Only the last block of a stream may leave a partial frame behind
+        int remainder = num_samples - pos;
+        if (remainder > 0) {
+            memcpy(pending.data(), in + pos, remainder * sizeof(float));
+            std::fill(pending.begin() + remainder, pending.end(), 0.0f);
+            process_frame(pending.data(), scratch.data());
+            memcpy(out + pos, scratch.data(), remainder * sizeof(float));
+        }
+    }
+
+    void push_output(const float* samples, int count)
+    {
+        int size = (int)fifo.size();
+        int write = (fifo_start + fifo_count) % size;
+        int first = std::min(count, size - write);
+        memcpy(&fifo[write], samples, first * sizeof(float));
+        memcpy(&fifo[0], samples + first, (count - first) * sizeof(float));
+        fifo_count += count;
+    }
+
+    void pop_output(float* samples, int count)
+    {
+        int size = (int)fifo.size();
+        int first = std::min(count, size - fifo_start);
+        memcpy(samples, &fifo[fifo_start], first * sizeof(float));
+        memcpy(samples + first, &fifo[0], (count - first) * sizeof(float));
+        fifo_start = (fifo_start + count) % size;
+        fifo_count -= count;
+    }
+
+    int frame_size;
+    int latency;
+
+    std::vector<float> pending;     // input waiting for a whole frame
+    int pending_count = 0;
+    std::vector<float> scratch;     // output of the frame being processed
+
+    std::vector<float> fifo;        // delayed output, at most two frames
+    int fifo_start = 0;
+    int fifo_count = 0;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "alloc_tracker.h"
+#include "audio_staging.h"
+#include "spsc_ring.h"
+#include "wav_stream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+Streams many WAV files block by block, read ahead by one background thread.
+
+Decoding every input before mixing starts delays the first block by the time it takes to read
+all of them, and holds all of their audio in memory. InputReader only parses each file's header
+up front. A single I/O thread then keeps every stream's ring of blocks topped up, a few hundred
+milliseconds ahead of the consumer, and the consumer takes the blocks out in place:
+
+    InputReader reader(config.interleaved);
+    int stream = reader.add_stream("input_1.wav", config.output_number_frames, config.output_sampling_rate);
+    reader.start();
+    ...
+    imm_input_audio_float(..., reader.acquire(stream), reader.get_frames_per_block(stream));     // once per block
+    reader.release(stream);
+    ...
+    reader.finish();
+
+A block covers the same time as a block of block_frames at block_sample_rate, whatever the
+file's own sample rate, and comes out in the layout the library was configured with. The thread
+waits until refill_blocks slots of a ring are free and then reads them with a single WavReader
+read, going round the streams so that none of them falls behind the others. Mono files are read
+straight into the ring's slots. Other files are read into a scratch buffer and converted to the
+library's layout from there. Past the end of its file, a stream returns silence.
+
+When a ring runs dry, acquire() waits for the I/O thread and counts an underrun. Memory per
+stream is fixed by readahead_blocks and refill_blocks, whatever the length of the file.
+
+*/
+
+struct InputReaderSettings
+{
+    int readahead_blocks = 32;      // blocks kept ready per stream, 320ms of 10ms blocks
+    int refill_blocks = 8;          // blocks read at once, when that many are free
+    int idle_sleep_ms = 2;          // how long the I/O thread sleeps when every ring is full
+};
+
+class InputReader
+{
+public:
+    explicit InputReader(bool interleaved, const InputReaderSettings& settings = InputReaderSettings())
+        : settings(settings), interleaved(interleaved)
+    {
+        this->settings.readahead_blocks = std::max(1, settings.readahead_blocks);
+        this->settings.refill_blocks = std::max(1, std::min(this->settings.readahead_blocks, settings.refill_blocks));
+    }
+
+    ~InputReader() { finish(); }
+
+    InputReader(const InputReader&) = delete;
+    InputReader& operator=(const InputReader&) = delete;
+
+    // Opens file_path for a new stream and reads its header. Returns the stream's index, or -1
+    // when the file cannot be read. Streams are added before start().
+    int add_stream(const std::string& file_path, int block_frames, int block_sample_rate)
+    {
+        std::unique_ptr<Stream> stream(new Stream());
+        if (!stream->file.open(file_path.c_str())) {
+            return -1;
+        }
+        stream->num_channels = stream->file.get_num_channels();
+        stream->frames_per_block = std::max(1, (int)((long long)block_frames * stream->file.get_sample_rate() / block_sample_rate));
+        int block_size = stream->num_channels * stream->frames_per_block;
+        stream->ring.reset(new SpscRing(settings.readahead_blocks, block_size));
+        stream->file.reserve(settings.refill_blocks * stream->frames_per_block);
+        if (stream->num_channels > 1) {
+            stream->scratch.assign((size_t)settings.refill_blocks * block_size, 0.0f);
+        }
+        stream->silence.assign(block_size, 0.0f);
+        streams.push_back(std::move(stream));
+        return (int)streams.size() - 1;
+    }
+
+    int get_sample_rate(int stream) const { return streams[stream]->file.get_sample_rate(); }
+    int get_num_channels(int stream) const { return streams[stream]->num_channels; }
+    int get_frames_per_block(int stream) const { return streams[stream]->frames_per_block; }
+    long long get_num_frames(int stream) const { return streams[stream]->file.get_num_frames(); }
+
+    // Launches the I/O thread, which starts filling every stream right away
+    void start()
+    {
+        if (!thread.joinable()) {
+            done = false;
+            thread = std::thread([this]() { run(); });
+        }
+    }
+
+    // Consumer side. The stream's next block, waiting while its ring is empty, or silence once
+    // the file has ended. Valid until release().
+    const float* acquire(int stream)
+    {
+        Stream& s = *streams[stream];
+        bool waited = false;
+        for (;;) {
+            // Read before the ring is checked: once it is set, every block is already in the ring
+            bool ended = s.end_of_file.load(std::memory_order_acquire);
+            SpscRing::Slot* slot = s.ring->try_acquire_read();
+            if (slot != NULL) {
+                s.holding = true;
+                return slot->data;
+            }
+            if (ended) {
+                return s.silence.data();
+            }
+            if (!waited) {
+                underruns.fetch_add(1, std::memory_order_relaxed);
+                waited = true;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Consumer side. Gives the block returned by acquire() back to the I/O thread.
+    void release(int stream)
+    {
+        Stream& s = *streams[stream];
+        if (s.holding) {
+            s.ring->release();
+            s.holding = false;
+        }
+    }
+
+    // Stops the I/O thread and closes the files
+    void finish()
+    {
+        if (thread.joinable()) {
+            done = true;
+            thread.join();
+        }
+        for (auto& stream : streams) {
+            stream->file.close();
+        }
+    }
+
+    size_t get_num_streams() const { return streams.size(); }
+    long long get_blocks() const { return blocks.load(std::memory_order_relaxed); }
+    long long get_reads() const { return reads.load(std::memory_order_relaxed); }
+
+    // True when reading any of the files failed, which ends that stream early. Call after finish().
+    bool has_failed() const
+    {
+        for (auto& stream : streams) {
+            if (stream->file.has_failed()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // How many acquire() calls found a ring empty and had to wait for the I/O thread, each
+    // counted once however long it then waited
+    long long get_underruns() const { return underruns.load(std::memory_order_relaxed); }
+
+    // Bytes held for all the streams' blocks, which do not depend on how long the files are
+    size_t get_buffered_bytes() const
+    {
+        size_t bytes = 0;
+        for (auto& stream : streams) {
+            size_t block_bytes = (size_t)stream->num_channels * stream->frames_per_block * sizeof(float);
+            bytes += block_bytes * (settings.readahead_blocks + 1) + stream->scratch.size() * sizeof(float);     // ring, silence, scratch
+        }
+        return bytes;
+    }
+
+    void print_report() const
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "Read %lld blocks from %zu files with %lld reads, %.0f KB buffered in all, %lld underruns",
+                 get_blocks(), streams.size(), get_reads(), get_buffered_bytes() / 1024.0, get_underruns());
+        std::cout << line << std::endl;
+        if (has_failed()) {
+            std::cout << "Reading an input file failed" << std::endl;
+        }
+    }
+
+private:
+    struct Stream
+    {
+        WavReader file;
+        std::unique_ptr<SpscRing> ring;
+        int num_channels = 0;
+        int frames_per_block = 0;
+        std::vector<float> scratch;         // channel after channel, refill_blocks blocks long, unused for mono
+        std::vector<float> silence;
+        std::atomic<bool> end_of_file{false};   // set once the last block is in the ring
+        bool holding = false;               // consumer side, acquire() returned a slot
+    };
+
+    void run()
+    {
+        AllocTracker::name_thread("reader");
+        while (!done) {
+            bool busy = false;
+            bool all_ended = true;
+            for (auto& stream : streams) {
+                if (stream->end_of_file.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                all_ended = false;
+                if (stream->ring->get_free_slots() >= settings.refill_blocks) {
+                    refill(*stream);
+                    busy = true;
+                }
+            }
+            if (all_ended) {
+                break;
+            }
+            if (!busy) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(settings.idle_sleep_ms));
+            }
+        }
+    }
+
+    void refill(Stream& stream)
+    {
+        if (stream.num_channels == 1) {
+            refill_in_place(stream);
+            return;
+        }
+        int frames = stream.frames_per_block;
+        int stride = settings.refill_blocks * frames;
+        int read = stream.file.read(stream.scratch.data(), stride, stride);
+        reads.fetch_add(1, std::memory_order_relaxed);
+        bool end = read < stride || stream.file.get_frames_left() == 0;
+
+        // The final partial block is zero-padded
+        int num_blocks = (read + frames - 1) / frames;
+        for (int c = 0; c < stream.num_channels && read < num_blocks * frames; c++) {
+            std::fill(stream.scratch.data() + (size_t)c * stride + read, stream.scratch.data() + (size_t)c * stride + num_blocks * frames, 0.0f);
+        }
+
+        for (int b = 0; b < num_blocks; b++) {
+            SpscRing::Slot* slot = stream.ring->try_acquire_write();
+            const float* block = stream.scratch.data() + (size_t)b * frames;
+            if (!interleaved || stream.num_channels == 1) {
+                for (int c = 0; c < stream.num_channels; c++) {
+                    memcpy(slot->data + (size_t)c * frames, block + (size_t)c * stride, frames * sizeof(float));
+                }
+            }
+            else if (stream.num_channels == 2) {
+                interleave_stereo(block, block + stride, slot->data, frames);
+            }
+            else {
+                for (int i = 0; i < frames; i++) {
+                    for (int c = 0; c < stream.num_channels; c++) {
+                        slot->data[(size_t)i * stream.num_channels + c] = block[(size_t)c * stride + i];
+                    }
+                }
+            }
+            slot->frames = frames;
+            stream.ring->publish();
+        }
+        blocks.fetch_add(num_blocks, std::memory_order_relaxed);
+
+        if (end) {
+            stream.end_of_file.store(true, std::memory_order_release);
+        }
+    }
+
+    // A mono block is the same in either layout, and slots that follow each other in the ring
+    // follow each other in memory, so mono files are read straight into the slots. Where the
+    // run of free slots wraps around the end of the ring, that takes a second read.
+    void refill_in_place(Stream& stream)
+    {
+        int frames = stream.frames_per_block;
+        int wanted = settings.refill_blocks;
+        bool end = false;
+        while (wanted > 0 && !end) {
+            int run = stream.ring->get_contiguous_free_slots(wanted);
+            float* data = stream.ring->try_acquire_write()->data;
+            int read = stream.file.read(data, run * frames, run * frames);
+            reads.fetch_add(1, std::memory_order_relaxed);
+            end = read < run * frames || stream.file.get_frames_left() == 0;
+
+            // The final partial block is zero-padded
+            int num_blocks = (read + frames - 1) / frames;
+            std::fill(data + read, data + (size_t)num_blocks * frames, 0.0f);
+            for (int b = 0; b < num_blocks; b++) {
+                stream.ring->try_acquire_write()->frames = frames;
+                stream.ring->publish();
+            }
+            blocks.fetch_add(num_blocks, std::memory_order_relaxed);
+            wanted -= run;
+        }
+
+        if (end) {
+            stream.end_of_file.store(true, std::memory_order_release);
+        }
+    }
+
+    InputReaderSettings settings;
+    bool interleaved;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::thread thread;
+    std::atomic<bool> done{false};
+    std::atomic<long long> blocks{0};
+    std::atomic<long long> reads{0};
+    std::atomic<long long> underruns{0};
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <math.h>
+
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+/*
+
+Measures the delay a processor adds to a signal.
+
+A probe signal (a logarithmic chirp, or a single impulse) is generated with a stretch of silence
+on either side. After it has been processed, the output is cross-correlated with the probe and
+the lag of the strongest peak is the delay in samples:
+
+    std::vector<float> probe = make_latency_probe(PROBE_CHIRP, sample_rate);
+    std::vector<float> output = ...process probe...
+    DelayEstimate estimate = estimate_delay(probe, output, sample_rate / 2);
+
+A chirp survives processors that treat a lone click as noise, and its correlation peak is just
+as sharp. The correlation is normalized, so a peak well below 1 means the output no longer
+resembles the probe and the delay should not be trusted.
+
+*/
+
+enum ProbeSignal
+{
+    PROBE_CHIRP = 0,
+    PROBE_IMPULSE
+};
+
+static const double PROBE_LEAD_SECONDS = 0.25;      // silence before the probe
+static const double PROBE_SECONDS = 0.5;            // length of the chirp
+static const double PROBE_TAIL_SECONDS = 1.0;       // silence after, for the delayed output to come out
+static const double PROBE_PI = 3.14159265358979323846;
+
+// The probe at one sample rate. The chirp sweeps from 100 Hz to max_frequency, by default 45% of
+// the sample rate. Chirps with the same max_frequency line up in time at any sample rate.
+inline std::vector<float> make_latency_probe(ProbeSignal signal, int sample_rate, double max_frequency = 0)
+{
+    int lead = (int)(PROBE_LEAD_SECONDS * sample_rate);
+    int length = (int)(PROBE_SECONDS * sample_rate);
+    int tail = (int)(PROBE_TAIL_SECONDS * sample_rate);
+    std::vector<float> probe((size_t)lead + length + tail, 0.0f);
+
+    if (signal == PROBE_IMPULSE) {
+        probe[lead] = 0.9f;
+        return probe;
+    }
+
+    double f0 = 100.0;
+    double f1 = max_frequency > 0 ? max_frequency : 0.45 * sample_rate;
+    double k = log(f1 / f0) / PROBE_SECONDS;
+    for (int i = 0; i < length; i++) {
+        double t = (double)i / sample_rate;
+        double phase = 2.0 * PROBE_PI * f0 * (exp(k * t) - 1.0) / k;
+        // Raised-cosine fades keep the edges from clicking
+        double fade = std::min(1.0, std::min(t, PROBE_SECONDS - t) / 0.01);
+        double window = 0.5 - 0.5 * cos(PROBE_PI * fade);
+        probe[(size_t)lead + i] = (float)(0.5 * window * sin(phase));
+    }
+    return probe;
+}
+
+struct DelayEstimate
+{
+    int samples = 0;            // delay of the output relative to the probe
+    double correlation = 0;     // normalized peak height, 1 for an exact delayed copy
+};
+
+// In-place radix-2 FFT, data.size() must be a power of two
+inline void latency_probe_fft(std::vector<std::complex<double>>& data, bool inverse)
+{
+    size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    for (size_t length = 2; length <= n; length <<= 1) {
+        double angle = 2.0 * PROBE_PI / length * (inverse ? 1 : -1);
+        std::complex<double> step(cos(angle), sin(angle));
+        for (size_t i = 0; i < n; i += length) {
+            std::complex<double> w(1.0, 0.0);
+            for (size_t k = 0; k < length / 2; k++) {
+                std::complex<double> a = data[i + k];
+                std::complex<double> b = data[i + k + length / 2] * w;
+                data[i + k] = a + b;
+                data[i + k + length / 2] = a - b;
+                w *= step;
+            }
+        }
+    }
+    if (inverse) {
+        for (std::complex<double>& value : data) {
+            value /= (double)n;
+        }
+    }
+}
+
+// Finds the lag, between 0 and max_lag samples, at which the output best matches the probe
+inline DelayEstimate estimate_delay(const std::vector<float>& probe, const std::vector<float>& output, int max_lag)
+{
+    size_t size = 1;
+    while (size < probe.size() + output.size()) {
+        size <<= 1;
+    }
+    std::vector<std::complex<double>> x(size), y(size);
+    double probe_energy = 0;
+    double output_energy = 0;
+    for (size_t i = 0; i < probe.size(); i++) {
+        x[i] = probe[i];
+        probe_energy += (double)probe[i] * probe[i];
+    }
+    for (size_t i = 0; i < output.size(); i++) {
+        y[i] = output[i];
+        output_energy += (double)output[i] * output[i];
+    }
+
+    // The cross-correlation is the inverse transform of Y * conj(X)
+    latency_probe_fft(x, false);
+    latency_probe_fft(y, false);
+    for (size_t i = 0; i < size; i++) {
+        y[i] *= std::conj(x[i]);
+    }
+    latency_probe_fft(y, true);
+
+    DelayEstimate estimate;
+    double best = 0;
+    for (int lag = 0; lag <= max_lag && lag < (int)size; lag++) {
+        double value = fabs(y[lag].real());
+        if (value > best) {
+            best = value;
+            estimate.samples = lag;
+        }
+    }
+    if (probe_energy > 0 && output_energy > 0) {
+        estimate.correlation = best / sqrt(probe_energy * output_energy);
+    }
+    return estimate;
+}
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define IMM_METRICS_HTTP 1
+#endif
+
+/*
+
+Metrics for running the harnesses as long-lived services, exported in the Prometheus text format.
+
+Counters, gauges and histograms are registered once, up front, and then updated from the
+processing threads:
+
+    MetricsRegistry metrics;
+    MetricCounter* blocks = metrics.counter("imm_blocks_processed_total", "Blocks mixed", "room=\"0\"");
+    MetricHistogram* calls = metrics.histogram("imm_call_duration_seconds", "Duration of imm_* calls",
+                                               MetricHistogram::latency_buckets(), "call=\"imm_output_audio_float\"");
+    MetricsExporter exporter(&metrics, "metrics.prom", 9464);
+    ...
+    blocks->add();
+    calls->observe(seconds);
+
+Updates are lock-free and never allocate. Counters and histograms are split into per-thread
+shards on their own cache lines, so processing threads do not contend over them, and the shards
+are only summed when the metrics are exported. Registering a metric takes a lock and allocates,
+so do it before processing starts.
+
+The exporter runs on its own thread. It rewrites a file every interval (write-then-rename, as
+the node_exporter textfile collector expects) and/or answers GET /metrics on a local port.
+
+*/
+
+// Updates from one thread land in one shard, picked once per thread
+static const int METRIC_SHARDS = 16;
+
+inline int metric_shard_index()
+{
+    static std::atomic<int> next_shard(0);
+    thread_local int shard = next_shard++ % METRIC_SHARDS;
+    return shard;
+}
+
+inline void metric_atomic_add(std::atomic<double>& target, double value)
+{
+    double current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+inline std::string metric_format_number(double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.17g", value);
+    return text;
+}
+
+// Label text for a metric with one label, e.g. metric_label("room", 3) gives room="3"
+inline std::string metric_label(const char* name, long long value)
+{
+    return std::string(name) + "=\"" + std::to_string(value) + "\"";
+}
+
+inline std::string metric_label(const char* name, const char* value)
+{
+    return std::string(name) + "=\"" + value + "\"";
+}
+
+class MetricCounter
+{
+public:
+    void add(uint64_t amount = 1)
+    {
+        shards[metric_shard_index()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const
+    {
+        uint64_t total = 0;
+        for (const Shard& shard : shards) {
+            total += shard.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> value{ 0 };
+    };
+    Shard shards[METRIC_SHARDS];
+};
+
+// A value that goes up and down, e.g. the number of participants in a room
+class MetricGauge
+{
+public:
+    void set(double new_value) { current.store(new_value, std::memory_order_relaxed); }
+    void add(double amount) { metric_atomic_add(current, amount); }
+    double value() const { return current.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> current{ 0 };
+};
+
+class MetricHistogram
+{
+public:
+    // Upper bounds of the buckets, in increasing order. A +Inf bucket is always added.
+    explicit MetricHistogram(std::vector<double> bounds)
+        : bounds(bounds), shards(new Shard[METRIC_SHARDS])
+    {
+        for (int s = 0; s < METRIC_SHARDS; s++) {
+            shards[s].buckets.reset(new std::atomic<uint64_t>[bounds.size() + 1]);
+            for (size_t b = 0; b <= bounds.size(); b++) {
+                shards[s].buckets[b] = 0;
+            }
+        }
+    }
+
+    // 10us to 100ms, for the duration of a call or a block
+    static std::vector<double> latency_buckets()
+    {
+        return { 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1 };
+    }
+
+    void observe(double value)
+    {
+        size_t bucket = 0;
+        while (bucket < bounds.size() && value > bounds[bucket]) {
+            bucket++;
+        }
+        Shard& shard = shards[metric_shard_index()];
+        shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        metric_atomic_add(shard.sum, value);
+    }
+
+    const std::vector<double>& get_bounds() const { return bounds; }
+
+    // Non-cumulative count of each bucket, the last one being +Inf
+    std::vector<uint64_t> bucket_counts() const
+    {
+        std::vector<uint64_t> counts(bounds.size() + 1, 0);
+        for (int s = 0; s < METRIC_SHARDS; s++) {
+            for (size_t b = 0; b <= bounds.size(); b++) {
+                counts[b] += shards[s].buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        return counts;
+    }
+
+    double sum() const
+    {
+        double total = 0;
+        for (int s = 0; s < METRIC_SHARDS; s++) {
+            total += shards[s].sum.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+        std::atomic<double> sum{ 0 };
+    };
+
+    std::vector<double> bounds;
+    std::unique_ptr<Shard[]> shards;
+};
+
+class MetricsRegistry
+{
+public:
+    // Each returns the existing metric if one with the same name and labels is already registered
+    MetricCounter* counter(const std::string& name, const std::string& help, const std::string& labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find_or_add(name, help, labels, "counter");
+        if (!entry->counter) {
+            entry->counter.reset(new MetricCounter());
+        }
+        return entry->counter.get();
+    }
+
+    MetricGauge* gauge(const std::string& name, const std::string& help, const std::string& labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find_or_add(name, help, labels, "gauge");
+        if (!entry->gauge) {
+            entry->gauge.reset(new MetricGauge());
+        }
+        return entry->gauge.get();
+    }
+
+    MetricHistogram* histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds, const std::string& labels = "")
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = find_or_add(name, help, labels, "histogram");
+        if (!entry->histogram) {
+            entry->histogram.reset(new MetricHistogram(bounds));
+        }
+        return entry->histogram.get();
+    }
+
+    // Every metric in the Prometheus text exposition format, series of a metric grouped together
+    std::string to_prometheus()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string text;
+        std::vector<bool> written(entries.size(), false);
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (written[i]) {
+                continue;
+            }
+            const Entry& first = *entries[i];
+            text += "# HELP " + first.name + " " + first.help + "\n";
+            text += "# TYPE " + first.name + " " + first.type + "\n";
+            for (size_t j = i; j < entries.size(); j++) {
+                if (!written[j] && entries[j]->name == first.name) {
+                    append_series(text, *entries[j]);
+                    written[j] = true;
+                }
+            }
+        }
+        return text;
+    }
+
+    // Writes to a temporary file first, so readers never see a half-written file
+    bool write_file(const char* file_path)
+    {
+        std::string text = to_prometheus();
+        std::string temporary_path = std::string(file_path) + ".tmp";
+        FILE* file = fopen(temporary_path.c_str(), "w");
+        if (file == NULL) {
+            return false;
+        }
+        bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        ok = fclose(file) == 0 && ok;
+        return ok && rename(temporary_path.c_str(), file_path) == 0;
+    }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        std::string help;
+        std::string labels;
+        const char* type;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    Entry* find_or_add(const std::string& name, const std::string& help, const std::string& labels, const char* type)
+    {
+        for (auto& entry : entries) {
+            if (entry->name == name && entry->labels == labels) {
+                return entry.get();
+            }
+        }
+        entries.emplace_back(new Entry());
+        Entry* entry = entries.back().get();
+        entry->name = name;
+        entry->help = help;
+        entry->labels = labels;
+        entry->type = type;
+        return entry;
+    }
+
+    static std::string braces(const std::string& labels, const std::string& extra = "")
+    {
+        std::string inside = labels.empty() ? extra : (extra.empty() ? labels : labels + "," + extra);
+        return inside.empty() ? "" : "{" + inside + "}";
+    }
+
+    static void append_series(std::string& text, const Entry& entry)
+    {
+        if (entry.counter) {
+            text += entry.name + braces(entry.labels) + " " + std::to_string(entry.counter->value()) + "\n";
+        }
+        else if (entry.gauge) {
+            text += entry.name + braces(entry.labels) + " " + metric_format_number(entry.gauge->value()) + "\n";
+        }
+        else if (entry.histogram) {
+            const std::vector<double>& bounds = entry.histogram->get_bounds();
+            std::vector<uint64_t> counts = entry.histogram->bucket_counts();
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < counts.size(); b++) {
+                cumulative += counts[b];
+                std::string le = b < bounds.size() ? metric_format_number(bounds[b]) : "+Inf";
+                text += entry.name + "_bucket" + braces(entry.labels, "le=\"" + le + "\"") + " " + std::to_string(cumulative) + "\n";
+            }
+            text += entry.name + "_sum" + braces(entry.labels) + " " + metric_format_number(entry.histogram->sum()) + "\n";
+            text += entry.name + "_count" + braces(entry.labels) + " " + std::to_string(cumulative) + "\n";
+        }
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Entry>> entries;
+};
+
+// Counts the error codes a set of calls return, as name{call="...",code="..."}. A series for
+// every call and expected code, and a code="other" series for each call, is registered up front,
+// so count() can be called from a processing thread: it never takes a lock or allocates.
+class MetricErrorCounters
+{
+public:
+    MetricErrorCounters(MetricsRegistry& registry, const std::string& name, const std::string& help, const std::string& labels,
+                        const std::vector<const char*>& calls, const std::vector<int>& codes)
+    {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        for (const char* call : calls) {
+            std::string call_labels = prefix + metric_label("call", call);
+            for (int code : codes) {
+                series.push_back(Series{ call, code, registry.counter(name, help, call_labels + "," + metric_label("code", (long long)code)) });
+            }
+            others.push_back(Series{ call, 0, registry.counter(name, help, call_labels + "," + metric_label("code", "other")) });
+        }
+    }
+
+    // Counts code unless it is 0, which means no error. Calls that were not registered are ignored.
+    void count(const char* call, int code)
+    {
+        if (code == 0) {
+            return;
+        }
+        for (Series& entry : series) {
+            if (entry.code == code && strcmp(entry.call, call) == 0) {
+                entry.counter->add();
+                return;
+            }
+        }
+        for (Series& entry : others) {
+            if (strcmp(entry.call, call) == 0) {
+                entry.counter->add();
+                return;
+            }
+        }
+    }
+
+private:
+    struct Series
+    {
+        const char* call;
+        int code;
+        MetricCounter* counter;
+    };
+
+    std::vector<Series> series;
+    std::vector<Series> others;
+};
+
+// Publishes a registry from a background thread: to a file every interval, and/or over HTTP
+// on 127.0.0.1:port. A file_path of NULL or a port of 0 turns that output off.
+class MetricsExporter
+{
+public:
+    MetricsExporter(MetricsRegistry* registry, const char* file_path, int port, double interval_seconds = 1.0)
+        : registry(registry), file_path(file_path != NULL ? file_path : ""), interval_seconds(interval_seconds)
+    {
+        if (port > 0 && !listen_on(port)) {
+            std::cout << "Failed to serve metrics on port " << port << std::endl;
+        }
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~MetricsExporter()
+    {
+        stopping = true;
+        thread.join();
+        // One last write, so the file holds the final values
+        if (!file_path.empty()) {
+            registry->write_file(file_path.c_str());
+        }
+#if defined(IMM_METRICS_HTTP)
+        if (server >= 0) {
+            close(server);
+        }
+#endif
+    }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+private:
+    void run()
+    {
+        std::chrono::steady_clock::time_point next_write = std::chrono::steady_clock::now();
+        while (!stopping) {
+            if (!file_path.empty() && std::chrono::steady_clock::now() >= next_write) {
+                if (!registry->write_file(file_path.c_str())) {
+                    std::cout << "Failed to write metrics to " << file_path << std::endl;
+                }
+                next_write += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval_seconds));
+            }
+            serve_one(100);
+        }
+    }
+
+    bool listen_on(int port)
+    {
+#if defined(IMM_METRICS_HTTP)
+        server = socket(AF_INET, SOCK_STREAM, 0);
+        if (server < 0) {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons((uint16_t)port);
+        if (bind(server, (sockaddr*)&address, sizeof(address)) != 0 || listen(server, 4) != 0) {
+            close(server);
+            server = -1;
+            return false;
+        }
+        return true;
+#else
+        (void)port;
+        return false;
+#endif
+    }
+
+    // Waits up to timeout_ms for a scrape and answers it
+    void serve_one(int timeout_ms)
+    {
+#if defined(IMM_METRICS_HTTP)
+        if (server >= 0) {
+            pollfd poll_server = { server, POLLIN, 0 };
+            if (poll(&poll_server, 1, timeout_ms) <= 0) {
+                return;
+            }
+            int client = accept(server, NULL, NULL);
+            if (client < 0) {
+                return;
+            }
+            char request[1024];
+            ssize_t length = recv(client, request, sizeof(request) - 1, 0);
+            request[length > 0 ? length : 0] = '\0';
+            std::string response;
+            if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+                std::string body = registry->to_prometheus();
+                response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size())
+                           + "\r\nConnection: close\r\n\r\n" + body;
+            }
+            else {
+                response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            }
+#if defined(MSG_NOSIGNAL)
+            int flags = MSG_NOSIGNAL; // a scraper hanging up early must not kill the process
+#else
+            int flags = 0;
+#endif
+            size_t sent = 0;
+            while (sent < response.size()) {
+                ssize_t n = send(client, response.data() + sent, response.size() - sent, flags);
+                if (n <= 0) {
+                    break;
+                }
+                sent += (size_t)n;
+            }
+            close(client);
+            return;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    }
+
+    MetricsRegistry* registry;
+    std::string file_path;
+    double interval_seconds;
+    std::atomic<bool> stopping{ false };
+    int server = -1;
+    std::thread thread;
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "alloc_tracker.h"
+#include "audio_staging.h"
+#include "spsc_ring.h"
+#include "wav_stream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+Writes many streams of audio blocks to WAV files from one background thread.
+
+A mixing thread that renders a block for every participant should not also be encoding and
+writing files. OutputWriter gives every stream a small ring of blocks and a WavWriter; the
+producer renders straight into a ring slot and commits it, and a single writer thread drains
+the rings, converts the blocks and appends them to their files:
+
+    OutputWriter writer(config.interleaved, config.output_number_channels, config.output_number_frames, 48000);
+    int stream = writer.add_stream("outfile_1.wav");
+    writer.start();
+    ...
+    imm_output_audio_float(..., writer.acquire(stream));     // once per block
+    writer.commit(stream);
+    ...
+    writer.finish();
+
+Blocks are collected into batches of batch_blocks before they are converted and written, so the
+files see a few large writes instead of one per block. Every flush_blocks blocks the batch is
+written out and the WAV header is brought up to date, so after a crash each file is playable up
+to its last flush. Memory per stream is fixed by queue_blocks and batch_blocks, whatever the
+length of the recording.
+
+A ring that is full makes the producer wait in acquire() until the writer catches up, so a
+slow disk eventually stalls the producer instead of growing a backlog. Blocks arrive in the
+layout the library was configured with, interleaved or channel after channel. Each stream has
+a single producer, which may differ between streams.
+
+*/
+
+struct OutputWriterSettings
+{
+    int queue_blocks = 16;      // blocks a stream can hold before its producer waits, 160ms of 10ms blocks
+    int batch_blocks = 8;       // blocks converted and written at once
+    int flush_blocks = 50;      // blocks between flushes, a crash loses at most this many
+    int bit_depth = 16;         // 16 (PCM) or 32 (float)
+    int idle_sleep_ms = 2;      // how long the writer sleeps when every ring is empty
+};
+
+class OutputWriter
+{
+public:
+    OutputWriter(bool interleaved, int num_channels, int frames_per_block, int sample_rate,
+                 const OutputWriterSettings& settings = OutputWriterSettings())
+        : settings(settings), interleaved(interleaved), num_channels(num_channels), frames_per_block(frames_per_block),
+          sample_rate(sample_rate)
+    {
+        this->settings.queue_blocks = std::max(1, settings.queue_blocks);
+        this->settings.batch_blocks = std::max(1, settings.batch_blocks);
+        this->settings.flush_blocks = std::max(this->settings.batch_blocks, settings.flush_blocks);
+    }
+
+    ~OutputWriter() { finish(); }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // Opens file_path for a new stream. Returns the stream's index, or -1 when the file cannot be
+    // opened. Streams are added before start().
+    int add_stream(const std::string& file_path)
+    {
+        std::unique_ptr<Stream> stream(new Stream(settings.queue_blocks, num_channels * frames_per_block));
+        if (!stream->file.open(file_path.c_str(), sample_rate, num_channels, settings.bit_depth)) {
+            return -1;
+        }
+        int batch_frames = settings.batch_blocks * frames_per_block;
+        stream->file.reserve(batch_frames);
+        stream->batch.assign((size_t)num_channels * batch_frames, 0.0f);
+        streams.push_back(std::move(stream));
+        return (int)streams.size() - 1;
+    }
+
+    // Launches the writer thread
+    void start()
+    {
+        if (!thread.joinable()) {
+            done = false;
+            thread = std::thread([this]() { run(); });
+        }
+    }
+
+    // Producer side. The slot to render the stream's next block into, waiting while its ring is
+    // full. The producer is usually a real-time thread, so it yields until the writer catches up
+    // instead of sleeping on the ring's lock.
+    float* acquire(int stream)
+    {
+        SpscRing& ring = streams[stream]->ring;
+        SpscRing::Slot* slot = ring.try_acquire_write();
+        if (slot == NULL) {
+            producer_waits.fetch_add(1, std::memory_order_relaxed);
+            while ((slot = ring.try_acquire_write()) == NULL) {
+                std::this_thread::yield();
+            }
+        }
+        return slot->data;
+    }
+
+    // Producer side. Hands the block filled since acquire() to the writer.
+    void commit(int stream)
+    {
+        streams[stream]->ring.publish();
+    }
+
+    // Writes out everything committed so far, stops the writer thread and closes the files.
+    // Returns false when any write failed.
+    bool finish()
+    {
+        if (thread.joinable()) {
+            done = true;
+            thread.join();
+        }
+        for (auto& stream : streams) {
+            if (!stream->file.close()) {
+                failed = true;
+            }
+        }
+        return !failed;
+    }
+
+    size_t get_num_streams() const { return streams.size(); }
+    long long get_blocks() const { return blocks.load(std::memory_order_relaxed); }
+    long long get_writes() const { return writes.load(std::memory_order_relaxed); }
+    long long get_flushes() const { return flushes.load(std::memory_order_relaxed); }
+    bool has_failed() const { return failed; }
+
+    // How many acquire() calls found their stream's ring full and had to wait for the writer
+    long long get_producer_waits() const { return producer_waits.load(std::memory_order_relaxed); }
+
+    // Bytes held for the stream's blocks, which do not depend on how long it runs
+    size_t get_bytes_per_stream() const
+    {
+        size_t block_bytes = (size_t)num_channels * frames_per_block * sizeof(float);
+        return block_bytes * settings.queue_blocks                                           // ring
+             + block_bytes * settings.batch_blocks                                           // batch
+             + (size_t)num_channels * frames_per_block * settings.batch_blocks * (settings.bit_depth / 8);   // encoded
+    }
+
+    void print_report() const
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "Wrote %lld blocks to %zu files with %lld writes and %lld flushes, %.0f KB per file in flight",
+                 get_blocks(), streams.size(), get_writes(), get_flushes(), get_bytes_per_stream() / 1024.0);
+        std::cout << line << std::endl;
+        if (get_producer_waits() > 0) {
+            std::cout << "Mixing waited " << get_producer_waits() << " times for the writer" << std::endl;
+        }
+        if (failed) {
+            std::cout << "Writing an output file failed" << std::endl;
+        }
+    }
+
+private:
+    struct Stream
+    {
+        Stream(int queue_blocks, int block_size) : ring(queue_blocks, block_size) {}
+
+        SpscRing ring;
+        WavWriter file;
+        std::vector<float> batch;       // channel after channel, batch_blocks blocks long
+        int batch_frames = 0;           // frames in batch
+        int blocks_since_flush = 0;
+    };
+
+    void run()
+    {
+        AllocTracker::name_thread("writer");
+        for (;;) {
+            // Read done before draining, so nothing committed before finish() is left behind
+            bool last_pass = done;
+            bool idle = true;
+            for (auto& stream : streams) {
+                SpscRing::Slot* slot;
+                while ((slot = stream->ring.try_acquire_read()) != NULL) {
+                    append(*stream, slot->data);
+                    stream->ring.release();
+                    idle = false;
+                }
+            }
+            if (last_pass) {
+                break;
+            }
+            if (idle) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(settings.idle_sleep_ms));
+            }
+        }
+        for (auto& stream : streams) {
+            write_batch(*stream);
+        }
+    }
+
+    void append(Stream& stream, const float* block)
+    {
+        int batch_size = settings.batch_blocks * frames_per_block;
+        float* batch = stream.batch.data() + stream.batch_frames;
+        if (!interleaved || num_channels == 1) {
+            for (int c = 0; c < num_channels; c++) {
+                memcpy(batch + (size_t)c * batch_size, block + (size_t)c * frames_per_block, frames_per_block * sizeof(float));
+            }
+        }
+        else if (num_channels == 2) {
+            deinterleave_stereo(block, batch, batch + batch_size, frames_per_block);
+        }
+        else {
+            for (int i = 0; i < frames_per_block; i++) {
+                for (int c = 0; c < num_channels; c++) {
+                    batch[(size_t)c * batch_size + i] = block[(size_t)i * num_channels + c];
+                }
+            }
+        }
+        stream.batch_frames += frames_per_block;
+        blocks.fetch_add(1, std::memory_order_relaxed);
+
+        if (++stream.blocks_since_flush >= settings.flush_blocks) {
+            write_batch(stream);
+            if (!stream.file.flush()) {
+                failed = true;
+            }
+            flushes.fetch_add(1, std::memory_order_relaxed);
+            stream.blocks_since_flush = 0;
+        }
+        else if (stream.batch_frames == batch_size) {
+            write_batch(stream);
+        }
+    }
+
+    void write_batch(Stream& stream)
+    {
+        if (stream.batch_frames == 0) {
+            return;
+        }
+        if (!stream.file.write(stream.batch.data(), stream.batch_frames, settings.batch_blocks * frames_per_block)) {
+            failed = true;
+        }
+        writes.fetch_add(1, std::memory_order_relaxed);
+        stream.batch_frames = 0;
+    }
+
+    OutputWriterSettings settings;
+    bool interleaved;
+    int num_channels;
+    int frames_per_block;
+    int sample_rate;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::thread thread;
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::atomic<long long> blocks{0};
+    std::atomic<long long> writes{0};
+    std::atomic<long long> flushes{0};
+    std::atomic<long long> producer_waits{0};
+};
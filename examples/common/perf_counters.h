@@ -0,0 +1,304 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+
+Optional hardware performance counter instrumentation for the processing loops.
+
+Each stage of a loop (reading, imm_input_audio_float, imm_output_audio_float, imm_cv_process,
+writing, ...) is bracketed with a StageScope. The profiler then records cycles, instructions,
+last level cache misses and branch misses for every stage of every block, using a
+perf_event_open counter group per thread, and prints per-stage totals and IPC at the end.
+Wall-clock time is recorded too, which together with the cycle count shows frequency scaling.
+
+    StageProfiler profiler({ "read", "process", "write" });
+    ...
+    {
+        StageScope scope(&profiler, STAGE_PROCESS, block);
+        imm_cv_process(...);
+    }
+    ...
+    profiler.print_report();
+
+A NULL profiler makes StageScope a no-op, so the instrumentation costs nothing when it is off.
+Counters are only available on Linux, and only for user space unless perf_event_paranoid
+allows more. Where they are unavailable the profiler still reports wall-clock time.
+
+*/
+
+enum PerfCounter
+{
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_COUNTERS
+};
+
+// One counter group for the calling thread
+class PerfCounterGroup
+{
+public:
+    PerfCounterGroup()
+    {
+#if defined(__linux__)
+        static const uint64_t configs[PERF_NUM_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] < 0) {
+                close_all();
+                return;
+            }
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        available = true;
+#endif
+    }
+
+    ~PerfCounterGroup() { close_all(); }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool is_available() const { return available; }
+
+    // Current counter values, scaled up if the kernel had to multiplex the counters
+    bool read_values(uint64_t values[PERF_NUM_COUNTERS])
+    {
+#if defined(__linux__)
+        if (available) {
+            uint64_t data[3 + PERF_NUM_COUNTERS];
+            if (read(fds[0], data, sizeof(data)) == (ssize_t)sizeof(data) && data[0] == PERF_NUM_COUNTERS) {
+                double scale = data[2] > 0 ? (double)data[1] / data[2] : 1.0;
+                for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+                    values[i] = (uint64_t)(data[3 + i] * scale);
+                }
+                return true;
+            }
+        }
+#endif
+        memset(values, 0, sizeof(uint64_t) * PERF_NUM_COUNTERS);
+        return false;
+    }
+
+private:
+    void close_all()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+#endif
+        available = false;
+    }
+
+    int fds[PERF_NUM_COUNTERS] = { -1, -1, -1, -1 };
+    bool available = false;
+};
+
+class StageProfiler
+{
+public:
+    struct Sample
+    {
+        long long block;
+        int stage;
+        double ns;
+        uint64_t counters[PERF_NUM_COUNTERS];
+    };
+
+    // Per-thread state: the thread's counter group and its own, pre-allocated, sample list
+    struct ThreadData
+    {
+        PerfCounterGroup group;
+        std::vector<Sample> samples;
+        size_t dropped = 0;
+    };
+
+    explicit StageProfiler(std::vector<std::string> stage_names, size_t max_samples_per_thread = 1 << 18)
+        : stage_names(stage_names), max_samples_per_thread(max_samples_per_thread), id(next_id()++)
+    {
+    }
+
+    // The calling thread's data, created on its first use
+    ThreadData* get_thread_data()
+    {
+        thread_local std::vector<std::pair<long long, ThreadData*>> cache;
+        for (auto& entry : cache) {
+            if (entry.first == id) {
+                return entry.second;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.emplace_back(new ThreadData());
+        ThreadData* data = threads.back().get();
+        data->samples.reserve(max_samples_per_thread);
+        cache.emplace_back(id, data);
+        return data;
+    }
+
+    void record(ThreadData* data, const Sample& sample)
+    {
+        if (data->samples.size() < max_samples_per_thread) {
+            data->samples.push_back(sample);
+        }
+        else {
+            data->dropped++;
+        }
+    }
+
+    void print_report()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int num_stages = (int)stage_names.size();
+        std::vector<long long> calls(num_stages, 0);
+        std::vector<double> ns(num_stages, 0);
+        std::vector<std::vector<double>> totals(num_stages, std::vector<double>(PERF_NUM_COUNTERS, 0));
+        bool have_counters = false;
+        size_t dropped = 0;
+        for (auto& thread : threads) {
+            have_counters = have_counters || thread->group.is_available();
+            dropped += thread->dropped;
+            for (const Sample& sample : thread->samples) {
+                calls[sample.stage]++;
+                ns[sample.stage] += sample.ns;
+                for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+                    totals[sample.stage][i] += (double)sample.counters[i];
+                }
+            }
+        }
+
+        if (!have_counters) {
+            std::cout << "Hardware performance counters are unavailable (check perf_event_paranoid), reporting wall-clock time only" << std::endl;
+        }
+        char line[256];
+        snprintf(line, sizeof(line), "%-24s %10s %12s %14s %14s %6s %8s %14s %14s",
+                 "stage", "calls", "us/call", "cycles/call", "instr/call", "IPC", "GHz", "LLC miss/call", "br miss/call");
+        std::cout << line << std::endl;
+        for (int s = 0; s < num_stages; s++) {
+            if (calls[s] == 0) {
+                continue;
+            }
+            double n = (double)calls[s];
+            double cycles = totals[s][PERF_CYCLES];
+            snprintf(line, sizeof(line), "%-24s %10lld %12.2f %14.0f %14.0f %6.2f %8.2f %14.1f %14.1f",
+                     stage_names[s].c_str(), calls[s], ns[s] / n / 1000.0, cycles / n, totals[s][PERF_INSTRUCTIONS] / n,
+                     cycles > 0 ? totals[s][PERF_INSTRUCTIONS] / cycles : 0.0, ns[s] > 0 ? cycles / ns[s] : 0.0,
+                     totals[s][PERF_LLC_MISSES] / n, totals[s][PERF_BRANCH_MISSES] / n);
+            std::cout << line << std::endl;
+        }
+        if (dropped > 0) {
+            std::cout << dropped << " samples did not fit in the sample buffers and are not included" << std::endl;
+        }
+    }
+
+    // One line per stage per block: block,stage,ns,cycles,instructions,llc_misses,branch_misses
+    bool write_csv(const char* file_path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE* file = fopen(file_path, "w");
+        if (file == NULL) {
+            std::cout << "Failed to open " << file_path << " for writing" << std::endl;
+            return false;
+        }
+        fprintf(file, "block,stage,ns,cycles,instructions,llc_misses,branch_misses\n");
+        for (auto& thread : threads) {
+            for (const Sample& sample : thread->samples) {
+                fprintf(file, "%lld,%s,%.0f,%llu,%llu,%llu,%llu\n", sample.block, stage_names[sample.stage].c_str(), sample.ns,
+                        (unsigned long long)sample.counters[PERF_CYCLES], (unsigned long long)sample.counters[PERF_INSTRUCTIONS],
+                        (unsigned long long)sample.counters[PERF_LLC_MISSES], (unsigned long long)sample.counters[PERF_BRANCH_MISSES]);
+            }
+        }
+        return fclose(file) == 0;
+    }
+
+private:
+    static std::atomic<long long>& next_id()
+    {
+        static std::atomic<long long> id(0);
+        return id;
+    }
+
+    std::vector<std::string> stage_names;
+    size_t max_samples_per_thread;
+    long long id;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadData>> threads;
+};
+
+// Measures one stage of one block, from construction to destruction
+class StageScope
+{
+public:
+    StageScope(StageProfiler* profiler, int stage, long long block)
+        : profiler(profiler)
+    {
+        if (profiler == NULL) {
+            return;
+        }
+        data = profiler->get_thread_data();
+        sample.block = block;
+        sample.stage = stage;
+        data->group.read_values(start_counters);
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~StageScope()
+    {
+        if (profiler == NULL) {
+            return;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        uint64_t end_counters[PERF_NUM_COUNTERS];
+        data->group.read_values(end_counters);
+        sample.ns = std::chrono::duration<double, std::nano>(end - start).count();
+        for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+            sample.counters[i] = end_counters[i] - start_counters[i];
+        }
+        profiler->record(data, sample);
+    }
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    StageProfiler* profiler;
+    StageProfiler::ThreadData* data = NULL;
+    StageProfiler::Sample sample;
+    uint64_t start_counters[PERF_NUM_COUNTERS];
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+/*
+
+How much memory the process is using, for tools that track memory as they scale up.
+
+current_rss_bytes() is the resident set size right now, read from /proc/self/statm on Linux and
+from the task info on macOS. peak_rss_bytes() is the largest it has been. Both return 0 where
+they are not supported. Memory the allocator keeps after it is freed still counts as resident.
+
+*/
+
+inline size_t current_rss_bytes()
+{
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    long pages = 0;
+    long resident = 0;
+    int read = fscanf(file, "%ld %ld", &pages, &resident);
+    fclose(file);
+    return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return (size_t)info.resident_size;
+#else
+    return 0;
+#endif
+}
+
+inline size_t peak_rss_bytes()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;             // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024;      // kilobytes on Linux
+#endif
+#else
+    return 0;
+#endif
+}
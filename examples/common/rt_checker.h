@@ -0,0 +1,429 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/*
+
+Real-time safety checks for the processing loops.
+
+Besides allocating, an audio thread glitches when it waits on a lock, makes a blocking system
+call or takes a page fault. The checker marks the real-time regions of a loop and reports any of
+these that happen inside them:
+
+    int region = RtChecker::register_region("imm_cv_process");
+    RtChecker::enable_checks(true);
+    ...
+    for (int block = 0; ...; block++) {
+        RtRegion rt_region(region, block >= warmup_blocks);
+        imm_cv_process(...);
+    }
+    ...
+    RtChecker::print_report();
+    if (RtChecker::get_violations() > 0) { fail the run }
+
+Locking, waiting, sleeping, file and stream I/O calls are intercepted by wrappers that forward to
+the real functions through dlsym(RTLD_NEXT). A call made inside a region past its warm-up is a
+violation. The first ones are logged to stderr with a stack trace, and the report lists every
+offending call site with its count. Page faults are read with getrusage(RUSAGE_THREAD) when a
+region is entered and left, so they are attributed to the region rather than a call.
+
+The wrappers are compiled into the one translation unit that defines IMM_RT_CHECKER_IMPLEMENTATION
+before including this header. They are only available on Linux, and are left out of sanitizer
+builds, which intercept the same functions. Link with ${CMAKE_DL_LIBS}, and export the program's
+symbols (-rdynamic) so the call sites have names.
+
+*/
+
+enum RtPolicy
+{
+    RT_POLICY_LOG = 0,  // log a stack trace for the first violations and carry on
+    RT_POLICY_ABORT     // abort on the first violation
+};
+
+class RtChecker
+{
+public:
+    static const int max_regions = 32;
+    static const int max_sites = 128;   // distinct (call, call site) pairs in the report
+    static const int max_logged = 10;   // stack traces logged before going quiet
+
+    // Registers a named region and returns its id. Call this before processing starts.
+    static int register_region(const char* name)
+    {
+        int id = -1;
+        for (int i = 0; i < num_regions.load(); i++) {
+            if (strcmp(regions[i].name, name) == 0) {
+                id = i;
+            }
+        }
+        if (id < 0 && num_regions.load() < max_regions) {
+            id = num_regions.load();
+            regions[id].name = name;
+            num_regions++;
+        }
+        return id;
+    }
+
+    // Nothing is checked until this is called
+    static void enable_checks(bool enable)
+    {
+#if defined(__linux__)
+        // backtrace() loads libgcc on its first call, do that now rather than while reporting
+        void* frames[1];
+        backtrace(frames, 1);
+        if (enable) {
+            prefault_code();
+        }
+#endif
+        checks_enabled = enable;
+    }
+
+    static bool checks_are_enabled() { return checks_enabled.load(std::memory_order_relaxed); }
+    static void set_policy(RtPolicy new_policy) { policy = new_policy; }
+
+    // Set by the wrappers, so the report can tell a clean loop from a build without them
+    static void mark_hooks_installed() { hooks_active = true; }
+    static bool hooks_installed() { return hooks_active.load(); }
+    static uint64_t get_violations() { return violations.load(); }
+
+    // Called by the wrappers before forwarding to the real function
+    static void on_call(const char* call, void* caller)
+    {
+        ThreadState& state = thread_state();
+        if (state.busy || state.region < 0 || !state.steady || !checks_are_enabled()) {
+            return;
+        }
+        state.busy = true;
+        regions[state.region].calls.fetch_add(1, std::memory_order_relaxed);
+        count_site(call, caller, state.region);
+
+        uint64_t count = ++violations;
+        if (policy.load() == RT_POLICY_ABORT || count <= (uint64_t)max_logged) {
+            char message[256];
+            int length = snprintf(message, sizeof(message), "%s called in real-time region %s\n", call, regions[state.region].name);
+            log_with_stack(message, length);
+        }
+        state.busy = false;
+    }
+
+    // Called by RtRegion when page faults happened while it was active
+    static void on_faults(int region, long minor, long major)
+    {
+        regions[region].minor_faults.fetch_add((uint64_t)minor, std::memory_order_relaxed);
+        regions[region].major_faults.fetch_add((uint64_t)major, std::memory_order_relaxed);
+        violations.fetch_add(1);
+    }
+
+    static void print_report()
+    {
+        ThreadState& state = thread_state();
+        bool busy = state.busy;
+        state.busy = true;
+        if (!hooks_installed()) {
+            std::cout << "Real-time checks are not available in this build, only page faults were counted" << std::endl;
+        }
+        char line[512];
+        snprintf(line, sizeof(line), "%-24s %14s %14s %14s", "region", "calls", "minor faults", "major faults");
+        std::cout << line << std::endl;
+        for (int i = 0; i < num_regions.load(); i++) {
+            const Region& region = regions[i];
+            snprintf(line, sizeof(line), "%-24s %14llu %14llu %14llu", region.name, (unsigned long long)region.calls.load(),
+                     (unsigned long long)region.minor_faults.load(), (unsigned long long)region.major_faults.load());
+            std::cout << line << std::endl;
+        }
+
+        int used = std::min(num_sites.load(), (int)max_sites);
+        if (used > 0) {
+            snprintf(line, sizeof(line), "%-24s %-24s %10s  %s", "call", "region", "count", "call site");
+            std::cout << line << std::endl;
+        }
+        for (int i = 0; i < used; i++) {
+            const Site& site = sites[i];
+            if (!site.ready.load()) {
+                continue;
+            }
+            char where[256];
+            describe_address(site.caller, where, sizeof(where));
+            snprintf(line, sizeof(line), "%-24s %-24s %10llu  %s", site.call, regions[site.region].name,
+                     (unsigned long long)site.count.load(), where);
+            std::cout << line << std::endl;
+        }
+        if (violations.load() > 0) {
+            std::cout << violations.load() << " blocking calls or page faults happened in the steady state of a real-time region" << std::endl;
+        }
+        state.busy = busy;
+    }
+
+private:
+    friend class RtRegion;
+
+    struct Region
+    {
+        const char* name = NULL;
+        std::atomic<uint64_t> calls{ 0 };
+        std::atomic<uint64_t> minor_faults{ 0 };
+        std::atomic<uint64_t> major_faults{ 0 };
+    };
+
+    struct Site
+    {
+        const char* call = NULL;
+        void* caller = NULL;
+        int region = 0;
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<bool> ready{ false };
+    };
+
+    // Plain data only, so the wrappers can read it from anywhere
+    struct ThreadState
+    {
+        int region = -1;
+        bool steady = false;
+        bool busy = false;  // set while the checker itself runs, so its own calls are not counted
+    };
+
+#if defined(__linux__)
+    // A real-time program locks its memory at startup (mlockall) so it never faults on it, which
+    // takes privileges. Touching every page of the loaded code is the part of that the checks
+    // need: otherwise the first run of a rarely taken path, such as waiting for a full queue to
+    // drain, faults its code in and counts as a violation.
+    static void prefault_code()
+    {
+        FILE* maps = fopen("/proc/self/maps", "r");
+        if (maps == NULL) {
+            return;
+        }
+        uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+        char line[512];
+        while (fgets(line, sizeof(line), maps) != NULL) {
+            unsigned long start, end;
+            char permissions[5];
+            if (sscanf(line, "%lx-%lx %4s", &start, &end, permissions) == 3 && permissions[0] == 'r' && permissions[2] == 'x') {
+                for (uintptr_t address = start; address < end; address += page_size) {
+                    (void)*(volatile const char*)address;
+                }
+            }
+        }
+        fclose(maps);
+    }
+#endif
+
+    static ThreadState& thread_state()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    // Two threads hitting a new call site at once may each add it, the report then lists it twice
+    static void count_site(const char* call, void* caller, int region)
+    {
+        int used = std::min(num_sites.load(), (int)max_sites);
+        for (int i = 0; i < used; i++) {
+            Site& site = sites[i];
+            if (site.ready.load() && site.caller == caller && site.region == region && strcmp(site.call, call) == 0) {
+                site.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        int index = num_sites.fetch_add(1);
+        if (index < max_sites) {
+            sites[index].call = call;
+            sites[index].caller = caller;
+            sites[index].region = region;
+            sites[index].count = 1;
+            sites[index].ready = true;
+        }
+    }
+
+    static void log_with_stack(const char* message, int length)
+    {
+#if defined(__linux__)
+        // Written straight to the file descriptor, stdio could lock or allocate
+        if (::write(STDERR_FILENO, message, std::min(length, 255)) > 0) {
+            void* frames[32];
+            backtrace_symbols_fd(frames, backtrace(frames, 32), STDERR_FILENO);
+        }
+#else
+        fputs(message, stderr);
+        (void)length;
+#endif
+        if (policy.load() == RT_POLICY_ABORT) {
+            abort();
+        }
+    }
+
+    static void describe_address(void* address, char* text, size_t size)
+    {
+#if defined(__linux__)
+        Dl_info info;
+        if (dladdr(address, &info) != 0) {
+            if (info.dli_sname != NULL) {
+                snprintf(text, size, "%s+0x%lx (%s)", info.dli_sname, (unsigned long)((char*)address - (char*)info.dli_saddr), info.dli_fname);
+                return;
+            }
+            if (info.dli_fname != NULL) {
+                snprintf(text, size, "%s+0x%lx", info.dli_fname, (unsigned long)((char*)address - (char*)info.dli_fbase));
+                return;
+            }
+        }
+#endif
+        snprintf(text, size, "%p", address);
+    }
+
+    static Region regions[max_regions];
+    static std::atomic<int> num_regions;
+    static Site sites[max_sites];
+    static std::atomic<int> num_sites;
+    static std::atomic<bool> checks_enabled;
+    static std::atomic<int> policy;
+    static std::atomic<uint64_t> violations;
+    static std::atomic<bool> hooks_active;
+};
+
+// All constant-initialized, so the wrappers can use them before main()
+inline RtChecker::Region RtChecker::regions[RtChecker::max_regions];
+inline std::atomic<int> RtChecker::num_regions{ 0 };
+inline RtChecker::Site RtChecker::sites[RtChecker::max_sites];
+inline std::atomic<int> RtChecker::num_sites{ 0 };
+inline std::atomic<bool> RtChecker::checks_enabled{ false };
+inline std::atomic<int> RtChecker::policy{ RT_POLICY_LOG };
+inline std::atomic<uint64_t> RtChecker::violations{ 0 };
+inline std::atomic<bool> RtChecker::hooks_active{ false };
+
+// Marks the calling thread as inside a real-time region until destruction. Regions nest.
+class RtRegion
+{
+public:
+    RtRegion(int region, bool steady_state = true)
+    {
+        RtChecker::ThreadState& state = RtChecker::thread_state();
+        previous_region = state.region;
+        previous_steady = state.steady;
+        state.region = region;
+        state.steady = region >= 0 && steady_state;
+#if defined(__linux__)
+        measuring = state.steady && RtChecker::checks_are_enabled();
+        if (measuring) {
+            getrusage(RUSAGE_THREAD, &start);
+        }
+#endif
+    }
+
+    ~RtRegion()
+    {
+        RtChecker::ThreadState& state = RtChecker::thread_state();
+#if defined(__linux__)
+        if (measuring) {
+            struct rusage end;
+            getrusage(RUSAGE_THREAD, &end);
+            long minor = end.ru_minflt - start.ru_minflt;
+            long major = end.ru_majflt - start.ru_majflt;
+            if (minor > 0 || major > 0) {
+                RtChecker::on_faults(state.region, minor, major);
+            }
+        }
+#endif
+        state.region = previous_region;
+        state.steady = previous_steady;
+    }
+
+    RtRegion(const RtRegion&) = delete;
+    RtRegion& operator=(const RtRegion&) = delete;
+
+private:
+    int previous_region;
+    bool previous_steady;
+#if defined(__linux__)
+    bool measuring = false;
+    struct rusage start;
+#endif
+};
+
+#if defined(IMM_RT_CHECKER_IMPLEMENTATION) && defined(__linux__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+
+static struct RtCheckerHooks
+{
+    RtCheckerHooks() { RtChecker::mark_hooks_installed(); }
+} rt_checker_hooks;
+
+// The real function behind a wrapper. A plain atomic rather than a function-local static,
+// whose initialization guard could itself take a lock.
+template <typename Function>
+inline Function rt_checker_next(std::atomic<void*>& next, const char* name)
+{
+    void* function = next.load(std::memory_order_acquire);
+    if (function == NULL) {
+        function = dlsym(RTLD_NEXT, name);
+        next.store(function, std::memory_order_release);
+    }
+    return (Function)function;
+}
+
+// Reports the call, then forwards it
+#define IMM_RT_CHECKED_CALL(name, ...)                                      \
+    static std::atomic<void*> next_function{ NULL };                        \
+    RtChecker::on_call(#name, __builtin_return_address(0));                 \
+    return rt_checker_next<decltype(&::name)>(next_function, #name)(__VA_ARGS__)
+
+extern "C" {
+
+// Locks and waits
+int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept { IMM_RT_CHECKED_CALL(pthread_mutex_lock, mutex); }
+int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept { IMM_RT_CHECKED_CALL(pthread_rwlock_rdlock, lock); }
+int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept { IMM_RT_CHECKED_CALL(pthread_rwlock_wrlock, lock); }
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) { IMM_RT_CHECKED_CALL(pthread_cond_wait, cond, mutex); }
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* time) { IMM_RT_CHECKED_CALL(pthread_cond_timedwait, cond, mutex, time); }
+int pthread_join(pthread_t thread, void** result) { IMM_RT_CHECKED_CALL(pthread_join, thread, result); }
+int sem_wait(sem_t* semaphore) { IMM_RT_CHECKED_CALL(sem_wait, semaphore); }
+
+// Sleeping
+int nanosleep(const struct timespec* duration, struct timespec* remaining) { IMM_RT_CHECKED_CALL(nanosleep, duration, remaining); }
+int usleep(useconds_t microseconds) { IMM_RT_CHECKED_CALL(usleep, microseconds); }
+unsigned int sleep(unsigned int seconds) { IMM_RT_CHECKED_CALL(sleep, seconds); }
+
+// File descriptors
+ssize_t read(int fd, void* buffer, size_t count) { IMM_RT_CHECKED_CALL(read, fd, buffer, count); }
+ssize_t write(int fd, const void* buffer, size_t count) { IMM_RT_CHECKED_CALL(write, fd, buffer, count); }
+int close(int fd) { IMM_RT_CHECKED_CALL(close, fd); }
+int open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+    if ((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE) {
+        va_list args;
+        va_start(args, flags);
+        mode = (mode_t)va_arg(args, int);
+        va_end(args);
+    }
+    IMM_RT_CHECKED_CALL(open, path, flags, mode);
+}
+
+// Streams, whose internal reads and writes do not go through the wrappers above
+FILE* fopen(const char* path, const char* mode) { IMM_RT_CHECKED_CALL(fopen, path, mode); }
+size_t fread(void* buffer, size_t size, size_t count, FILE* file) { IMM_RT_CHECKED_CALL(fread, buffer, size, count, file); }
+size_t fwrite(const void* buffer, size_t size, size_t count, FILE* file) { IMM_RT_CHECKED_CALL(fwrite, buffer, size, count, file); }
+int fflush(FILE* file) { IMM_RT_CHECKED_CALL(fflush, file); }
+int fclose(FILE* file) { IMM_RT_CHECKED_CALL(fclose, file); }
+}
+
+#undef IMM_RT_CHECKED_CALL
+
+#endif
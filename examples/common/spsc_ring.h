@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+Lock-free single-producer single-consumer ring of pre-allocated audio blocks.
+
+Every slot owns slot_size floats plus a small header, all allocated once in the
+constructor. The producer fills a slot in place and publishes it, the consumer reads it in
+place and releases it, so nothing is copied or allocated while audio is flowing.
+
+A full ring is how backpressure works: the producer waits in acquire_write() until the
+consumer has released a slot. A side that has to wait yields a few times and then sleeps until
+the other side publishes or releases a slot, so a stage held up by a slower one does not keep
+a core busy. publish() and release() only take the lock when the other side is asleep.
+
+    SpscRing ring(8, 480);
+    // producer                              // consumer
+    SpscRing::Slot* w = ring.acquire_write(); SpscRing::Slot* r = ring.acquire_read();
+    fill(w->data);                            use(r->data);
+    ring.publish();                           ring.release();
+
+*/
+class SpscRing
+{
+public:
+    struct Slot
+    {
+        float* data;        // slot_size floats
+        int frames;         // valid frames in this slot
+        long long index;    // block index, set by the producer
+        bool last;          // true for the final slot of the stream
+    };
+
+    SpscRing(int capacity, int slot_size)
+        : storage((size_t)capacity * slot_size), slots(capacity), capacity(capacity), slot_size(slot_size)
+    {
+        for (int i = 0; i < capacity; i++) {
+            slots[i].data = &storage[(size_t)i * slot_size];
+            slots[i].frames = 0;
+            slots[i].index = 0;
+            slots[i].last = false;
+        }
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    int get_capacity() const { return capacity; }
+    int get_slot_size() const { return slot_size; }
+
+    // Producer side. Returns NULL when the ring is full.
+    Slot* try_acquire_write()
+    {
+        size_t head = write_pos.load(std::memory_order_relaxed);
+        if (head - read_pos.load(std::memory_order_acquire) == (size_t)capacity) {
+            return NULL;
+        }
+        return &slots[head % capacity];
+    }
+
+    // Producer side. Waits while the ring is full.
+    Slot* acquire_write()
+    {
+        Slot* slot = try_acquire_write();
+        if (slot == NULL) {
+            producer_waits.fetch_add(1, std::memory_order_relaxed);
+            slot = wait([this]() { return try_acquire_write(); }, producer_sleeping);
+        }
+        return slot;
+    }
+
+    // Producer side. How many slots can be filled before the ring is full.
+    int get_free_slots() const
+    {
+        return capacity - (int)(write_pos.load(std::memory_order_relaxed) - read_pos.load(std::memory_order_acquire));
+    }
+
+    // Producer side. How many free slots, up to max_slots, follow each other in memory from the
+    // next one on, so a producer can fill them at once from try_acquire_write()->data.
+    int get_contiguous_free_slots(int max_slots) const
+    {
+        int to_end = capacity - (int)(write_pos.load(std::memory_order_relaxed) % capacity);
+        return std::min(std::min(max_slots, to_end), get_free_slots());
+    }
+
+    void publish()
+    {
+        write_pos.store(write_pos.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        wake(consumer_sleeping);
+    }
+
+    // Consumer side. Returns NULL when the ring is empty.
+    Slot* try_acquire_read()
+    {
+        size_t tail = read_pos.load(std::memory_order_relaxed);
+        if (tail == write_pos.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &slots[tail % capacity];
+    }
+
+    // Consumer side. Waits while the ring is empty.
+    Slot* acquire_read()
+    {
+        Slot* slot = try_acquire_read();
+        if (slot == NULL) {
+            consumer_waits.fetch_add(1, std::memory_order_relaxed);
+            slot = wait([this]() { return try_acquire_read(); }, consumer_sleeping);
+        }
+        return slot;
+    }
+
+    void release()
+    {
+        read_pos.store(read_pos.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        wake(producer_sleeping);
+    }
+
+    // How many acquire_write() calls found the ring full (producer) and how many acquire_read()
+    // calls found it empty (consumer), each counted once however long it then waited
+    long long get_producer_waits() const { return producer_waits.load(std::memory_order_relaxed); }
+    long long get_consumer_waits() const { return consumer_waits.load(std::memory_order_relaxed); }
+
+private:
+    // Yields this many times before going to sleep
+    static const int spin_yields = 64;
+
+    template <class TryAcquire>
+    Slot* wait(TryAcquire&& try_acquire, std::atomic<bool>& sleeping)
+    {
+        Slot* slot;
+        for (int i = 0; i < spin_yields; i++) {
+            std::this_thread::yield();
+            if ((slot = try_acquire()) != NULL) {
+                return slot;
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        // Pairs with the fence in wake(): either the other side sees sleeping, or this sees its slot
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while ((slot = try_acquire()) == NULL) {
+            wake_cv.wait(lock);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+        return slot;
+    }
+
+    void wake(std::atomic<bool>& sleeping)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake_cv.notify_all();
+        }
+    }
+
+    std::vector<float> storage;
+    std::vector<Slot> slots;
+    int capacity;
+    int slot_size;
+
+    // Kept on separate cache lines so the two threads do not fight over them
+    alignas(64) std::atomic<size_t> write_pos{0};
+    alignas(64) std::atomic<size_t> read_pos{0};
+    alignas(64) std::atomic<long long> producer_waits{0};
+    alignas(64) std::atomic<long long> consumer_waits{0};
+    alignas(64) std::atomic<bool> producer_sleeping{false};
+    std::atomic<bool> consumer_sleeping{false};
+    std::mutex mutex;
+    std::condition_variable wake_cv;
+};
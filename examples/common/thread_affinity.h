@@ -0,0 +1,77 @@
+#pragma once
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <thread>
+#include <vector>
+
+/*
+
+Pin the calling thread to one CPU so benchmark numbers are not disturbed by the scheduler
+moving it around. Returns false where pinning is not supported (macOS only offers affinity
+hints) or the CPU does not exist.
+
+*/
+inline bool pin_current_thread(int cpu)
+{
+    if (cpu < 0) {
+        return false;
+    }
+#if defined(_WIN32)
+    if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+/*
+
+The CPUs this process may run on, in ascending order. Under taskset or a cgroup cpuset that can be
+fewer than the machine has, and not numbered from 0, so workers that are pinned one per CPU pick
+their CPUs from here. Where the affinity cannot be read, every CPU is assumed to be available.
+
+*/
+inline std::vector<int> get_allowed_cpus()
+{
+    std::vector<int> cpus;
+#if defined(_WIN32)
+    DWORD_PTR process_mask, system_mask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++) {
+            if ((process_mask >> cpu) & 1) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        int num_cpus = (int)std::thread::hardware_concurrency();
+        for (int cpu = 0; cpu < (num_cpus > 0 ? num_cpus : 1); cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
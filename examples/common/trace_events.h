@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+
+Timeline tracing for the processing loops, exported in the Chrome trace-event format so it can
+be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+Every call of interest is bracketed with a TraceSpan, tagged with the room, participant and
+block it worked on:
+
+    TraceRecorder tracer;
+    ...
+    {
+        TraceSpan span(&tracer, "imm_output_audio_float", room_id, participant_id, block);
+        imm_output_audio_float(...);
+    }
+    ...
+    tracer.write_json("trace.json");
+
+Each thread appends to its own pre-allocated buffer, so recording takes no locks and does not
+allocate once a thread has recorded its first span. A span is stored once, with its begin and
+end time, and exported as a complete ("X") event. Spans that do not fit in the buffer are
+dropped and counted. A NULL recorder makes TraceSpan a no-op.
+
+*/
+
+class TraceRecorder
+{
+public:
+    struct Event
+    {
+        const char* name;
+        int64_t begin_ns;
+        int64_t end_ns;
+        int room;           // -1 when not tied to a room
+        int participant;    // -1 when not tied to a participant
+        long long block;    // -1 when not tied to a block
+    };
+
+    // Per-thread buffer, only ever written by its own thread
+    struct ThreadBuffer
+    {
+        int thread_index = 0;
+        const char* thread_name = NULL;
+        std::vector<Event> events;
+        std::atomic<size_t> count{ 0 };
+        size_t dropped = 0;
+    };
+
+    explicit TraceRecorder(size_t max_events_per_thread = 1 << 18)
+        : max_events_per_thread(max_events_per_thread), origin(std::chrono::steady_clock::now()), id(next_id()++)
+    {
+    }
+
+    // The calling thread's buffer, created on its first use
+    ThreadBuffer* get_thread_buffer()
+    {
+        thread_local std::vector<std::pair<long long, ThreadBuffer*>> cache;
+        for (auto& entry : cache) {
+            if (entry.first == id) {
+                return entry.second;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.emplace_back(new ThreadBuffer());
+        ThreadBuffer* buffer = threads.back().get();
+        buffer->thread_index = (int)threads.size();
+        buffer->events.resize(max_events_per_thread);
+        cache.emplace_back(id, buffer);
+        return buffer;
+    }
+
+    // Names the calling thread in the timeline
+    void name_thread(const char* name)
+    {
+        get_thread_buffer()->thread_name = name;
+    }
+
+    int64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(ThreadBuffer* buffer, const Event& event)
+    {
+        size_t index = buffer->count.load(std::memory_order_relaxed);
+        if (index < buffer->events.size()) {
+            buffer->events[index] = event;
+            buffer->count.store(index + 1, std::memory_order_release);
+        }
+        else {
+            buffer->dropped++;
+        }
+    }
+
+    // Writes every recorded span. Safe to call while other threads are still recording,
+    // spans they record during the export are left out.
+    bool write_json(const char* file_path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE* file = fopen(file_path, "w");
+        if (file == NULL) {
+            std::cout << "Failed to open " << file_path << " for writing" << std::endl;
+            return false;
+        }
+        fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"immersitech\"}}");
+        size_t dropped = 0;
+        for (auto& thread : threads) {
+            if (thread->thread_name != NULL) {
+                fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        thread->thread_index, thread->thread_name);
+            }
+            size_t count = thread->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; i++) {
+                const Event& event = thread->events[i];
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                        event.name, thread->thread_index, event.begin_ns / 1000.0, (event.end_ns - event.begin_ns) / 1000.0);
+                const char* separator = "";
+                if (event.room >= 0) {
+                    fprintf(file, "\"room\":%d", event.room);
+                    separator = ",";
+                }
+                if (event.participant >= 0) {
+                    fprintf(file, "%s\"participant\":%d", separator, event.participant);
+                    separator = ",";
+                }
+                if (event.block >= 0) {
+                    fprintf(file, "%s\"block\":%lld", separator, event.block);
+                }
+                fprintf(file, "}}");
+            }
+            dropped += thread->dropped;
+        }
+        fprintf(file, "\n]}\n");
+        if (dropped > 0) {
+            std::cout << dropped << " trace events did not fit in the trace buffers and are not included" << std::endl;
+        }
+        return fclose(file) == 0;
+    }
+
+private:
+    static std::atomic<long long>& next_id()
+    {
+        static std::atomic<long long> id(0);
+        return id;
+    }
+
+    size_t max_events_per_thread;
+    std::chrono::steady_clock::time_point origin;
+    long long id;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+};
+
+// Records one span, from construction to destruction
+class TraceSpan
+{
+public:
+    TraceSpan(TraceRecorder* recorder, const char* name, int room = -1, int participant = -1, long long block = -1)
+        : recorder(recorder)
+    {
+        if (recorder == NULL) {
+            return;
+        }
+        buffer = recorder->get_thread_buffer();
+        event.name = name;
+        event.room = room;
+        event.participant = participant;
+        event.block = block;
+        event.begin_ns = recorder->now_ns();
+    }
+
+    ~TraceSpan()
+    {
+        if (recorder == NULL) {
+            return;
+        }
+        event.end_ns = recorder->now_ns();
+        recorder->record(buffer, event);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceRecorder* recorder;
+    TraceRecorder::ThreadBuffer* buffer = NULL;
+    TraceRecorder::Event event;
+};
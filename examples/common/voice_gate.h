@@ -0,0 +1,94 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+
+#include <algorithm>
+
+/*
+
+Decides, block by block, whether a participant is talking, so that silent participants do not
+have to be processed.
+
+The gate measures the energy of each block and compares it with the participant's noise floor,
+which it tracks as it goes: it follows the energy down right away and up only slowly, so the
+floor settles on the background noise between words. A block opens the gate when it is
+open_margin_db above the floor and above min_open_db. Speech has short gaps between syllables and
+soft word endings, so once open, the gate stays open until hangover_blocks blocks in a row have
+been quiet:
+
+    VoiceGate gate;
+    if (gate.process(input, frames * channels)) {
+        imm_input_audio_float(..., input, frames);
+    }
+
+The energy is one multiply-add per sample, far cheaper than the input processing it can skip.
+The block that opens the gate is always let through, so speech is not cut at its start, but
+there is no look-ahead: the first block of a word that starts very softly can be missed.
+
+*/
+
+struct VoiceGateSettings
+{
+    float min_open_db = -50;        // dBFS, quieter blocks never open the gate
+    float open_margin_db = 9;       // dB above the noise floor that opens the gate
+    float floor_rise_db = 0.02f;    // dB the noise floor may rise per block, about 2 dB per second for 10ms blocks
+    int hangover_blocks = 30;       // quiet blocks before the gate closes, 300ms for 10ms blocks
+};
+
+class VoiceGate
+{
+public:
+    // The noise floor starts out, and stays, just low enough for min_open_db to open the gate
+    explicit VoiceGate(const VoiceGateSettings& settings = VoiceGateSettings())
+        : settings(settings), noise_floor_db(settings.min_open_db - settings.open_margin_db)
+    {
+    }
+
+    // Returns true when the block should be processed
+    bool process(const float* samples, size_t count)
+    {
+        float sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += samples[i] * samples[i];
+        }
+        float level_db = count > 0 ? 10.0f * log10f(sum / count + 1e-12f) : -120.0f;
+
+        // Blocks quieter than min_open_db never open the gate, so the floor need not go lower. That
+        // also keeps a block of digital silence from dropping it out of reach of the noise.
+        if (level_db < noise_floor_db) {
+            noise_floor_db = std::max(level_db, settings.min_open_db - settings.open_margin_db);
+        }
+        else {
+            noise_floor_db += settings.floor_rise_db;
+        }
+
+        bool loud = level_db >= settings.min_open_db && level_db >= noise_floor_db + settings.open_margin_db;
+        if (loud) {
+            quiet_blocks = 0;
+            open = true;
+        }
+        else if (open && ++quiet_blocks > settings.hangover_blocks) {
+            open = false;
+        }
+
+        blocks++;
+        if (open) {
+            open_blocks++;
+        }
+        return open;
+    }
+
+    bool is_open() const { return open; }
+    float get_noise_floor_db() const { return noise_floor_db; }
+    long long get_blocks() const { return blocks; }
+    long long get_open_blocks() const { return open_blocks; }
+
+private:
+    VoiceGateSettings settings;
+    float noise_floor_db;
+    int quiet_blocks = 0;
+    bool open = false;
+    long long blocks = 0;
+    long long open_blocks = 0;
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/*
+
+Streaming WAV reader and writer.
+
+Unlike AudioFile, which decodes a whole file into memory, these read and write a block of
+frames at a time, so a file can be processed while it is being read. Audio is exchanged as
+deinterleaved float blocks: channel c of a block starts at block + c * channel_stride.
+
+WavReader understands 8/16/24/32 bit PCM and 32 bit float, including WAVE_FORMAT_EXTENSIBLE.
+WavWriter writes 16 bit PCM or 32 bit float and keeps the header valid on every flush(), so
+a file that is being written stays playable up to the last flushed block.
+
+Both assume a little-endian host, like the rest of the examples.
+
+*/
+
+class WavReader
+{
+public:
+    WavReader() {}
+    ~WavReader() { close(); }
+
+    WavReader(const WavReader&) = delete;
+    WavReader& operator=(const WavReader&) = delete;
+
+    bool open(const char* file_path)
+    {
+        close();
+        failed = false;
+        file = fopen(file_path, "rb");
+        if (file == NULL) {
+            std::cout << "Failed to open " << file_path << std::endl;
+            return false;
+        }
+
+        uint8_t riff[12];
+        if (fread(riff, 1, 12, file) != 12 || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+            std::cout << file_path << " is not a WAV file" << std::endl;
+            close();
+            return false;
+        }
+
+        // Walk the chunks until we have seen "fmt " and reached "data"
+        bool have_format = false;
+        uint8_t chunk[8];
+        while (fread(chunk, 1, 8, file) == 8) {
+            uint32_t chunk_size = read_u32(chunk + 4);
+            if (memcmp(chunk, "fmt ", 4) == 0) {
+                uint8_t fmt[40] = { 0 };
+                uint32_t n = std::min<uint32_t>(chunk_size, sizeof(fmt));
+                if (fread(fmt, 1, n, file) != n) {
+                    break;
+                }
+                format = read_u16(fmt);
+                num_channels = read_u16(fmt + 2);
+                sample_rate = (int)read_u32(fmt + 4);
+                bits_per_sample = read_u16(fmt + 14);
+                if (format == WAVE_FORMAT_EXTENSIBLE && n >= 26) {
+                    format = read_u16(fmt + 24);
+                }
+                fseek(file, (long)(chunk_size - n + (chunk_size & 1)), SEEK_CUR);
+                have_format = true;
+            }
+            else if (memcmp(chunk, "data", 4) == 0) {
+                if (!have_format) {
+                    break;
+                }
+                bytes_per_frame = num_channels * (bits_per_sample / 8);
+                num_frames = bytes_per_frame > 0 ? chunk_size / bytes_per_frame : 0;
+                frames_left = num_frames;
+                bool supported = (format == WAVE_FORMAT_PCM && (bits_per_sample == 8 || bits_per_sample == 16 || bits_per_sample == 24 || bits_per_sample == 32))
+                              || (format == WAVE_FORMAT_IEEE_FLOAT && bits_per_sample == 32);
+                if (!supported || num_channels <= 0) {
+                    std::cout << file_path << " uses an unsupported WAV format" << std::endl;
+                    close();
+                    return false;
+                }
+                return true;
+            }
+            else {
+                fseek(file, (long)(chunk_size + (chunk_size & 1)), SEEK_CUR);
+            }
+        }
+
+        std::cout << file_path << " has no audio data" << std::endl;
+        close();
+        return false;
+    }
+
+    void close()
+    {
+        if (file != NULL) {
+            fclose(file);
+            file = NULL;
+        }
+    }
+
+    int get_sample_rate() const { return sample_rate; }
+    int get_num_channels() const { return num_channels; }
+    long long get_num_frames() const { return num_frames; }
+    long long get_frames_left() const { return frames_left; }
+
+    // True once a read failed with an I/O error, as opposed to reaching the end of the file
+    bool has_failed() const { return failed; }
+
+    // Size the scratch buffer up front so read() never allocates
+    void reserve(int max_frames) { scratch.resize((size_t)max_frames * bytes_per_frame); }
+
+    // Read up to num_frames frames. Returns the number of frames read, 0 at the end of the file
+    // or after an error (see has_failed()).
+    int read(float* block, int num_frames_wanted, int channel_stride)
+    {
+        if (file == NULL) {
+            return 0;
+        }
+        int frames = (int)std::min<long long>(num_frames_wanted, frames_left);
+        if ((size_t)frames * bytes_per_frame > scratch.size()) {
+            reserve(frames);
+        }
+        frames = (int)(fread(scratch.data(), bytes_per_frame, frames, file));
+        frames_left -= frames;
+        if (ferror(file)) {
+            failed = true;
+            frames_left = 0;
+        }
+
+        int bytes_per_sample = bits_per_sample / 8;
+        for (int c = 0; c < num_channels; c++) {
+            const uint8_t* src = scratch.data() + c * bytes_per_sample;
+            float* dst = block + (size_t)c * channel_stride;
+            for (int i = 0; i < frames; i++, src += bytes_per_frame) {
+                dst[i] = decode(src);
+            }
+        }
+        return frames;
+    }
+
+private:
+    static const int WAVE_FORMAT_PCM = 1;
+    static const int WAVE_FORMAT_IEEE_FLOAT = 3;
+    static const int WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+    static uint16_t read_u16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+    static uint32_t read_u32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+    float decode(const uint8_t* p) const
+    {
+        switch (bits_per_sample) {
+        case 8:
+            return ((int)p[0] - 128) / 128.0f;
+        case 16:
+            return (int16_t)read_u16(p) / 32768.0f;
+        case 24:
+            return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.0f;
+        default:
+            if (format == WAVE_FORMAT_IEEE_FLOAT) {
+                float f;
+                memcpy(&f, p, sizeof(f));
+                return f;
+            }
+            return (int32_t)read_u32(p) / 2147483648.0f;
+        }
+    }
+
+    FILE* file = NULL;
+    int format = 0;
+    int num_channels = 0;
+    int sample_rate = 0;
+    int bits_per_sample = 0;
+    int bytes_per_frame = 0;
+    long long num_frames = 0;
+    long long frames_left = 0;
+    bool failed = false;
+    std::vector<uint8_t> scratch;
+};
+
+class WavWriter
+{
+public:
+    WavWriter() {}
+    ~WavWriter() { close(); }
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    // bit_depth is 16 (PCM) or 32 (float)
+    bool open(const char* file_path, int sample_rate, int num_channels, int bit_depth = 16)
+    {
+        close();
+        file = fopen(file_path, "wb");
+        if (file == NULL) {
+            std::cout << "Failed to open " << file_path << " for writing" << std::endl;
+            return false;
+        }
+        this->num_channels = num_channels;
+        this->bit_depth = bit_depth == 32 ? 32 : 16;
+        frames_written = 0;
+
+        uint8_t header[44];
+        int bytes_per_frame = num_channels * (this->bit_depth / 8);
+        memcpy(header, "RIFF", 4);
+        write_u32(header + 4, 36);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        write_u32(header + 16, 16);
+        write_u16(header + 20, this->bit_depth == 32 ? 3 : 1);
+        write_u16(header + 22, (uint16_t)num_channels);
+        write_u32(header + 24, (uint32_t)sample_rate);
+        write_u32(header + 28, (uint32_t)(sample_rate * bytes_per_frame));
+        write_u16(header + 32, (uint16_t)bytes_per_frame);
+        write_u16(header + 34, (uint16_t)this->bit_depth);
+        memcpy(header + 36, "data", 4);
+        write_u32(header + 40, 0);
+        return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    }
+
+    // Size the scratch buffer up front so write() never allocates
+    void reserve(int max_frames) { scratch.resize((size_t)max_frames * num_channels * (bit_depth / 8)); }
+
+    bool write(const float* block, int num_frames, int channel_stride)
+    {
+        if (file == NULL) {
+            return false;
+        }
+        int bytes_per_sample = bit_depth / 8;
+        size_t bytes = (size_t)num_frames * num_channels * bytes_per_sample;
+        if (bytes > scratch.size()) {
+            reserve(num_frames);
+        }
+        for (int c = 0; c < num_channels; c++) {
+            const float* src = block + (size_t)c * channel_stride;
+            uint8_t* dst = scratch.data() + c * bytes_per_sample;
+            for (int i = 0; i < num_frames; i++, dst += num_channels * bytes_per_sample) {
+                if (bit_depth == 32) {
+                    memcpy(dst, &src[i], sizeof(float));
+                }
+                else {
+                    float v = std::max(-1.0f, std::min(1.0f, src[i]));
+                    write_u16(dst, (uint16_t)(int16_t)(v * 32767.0f));
+                }
+            }
+        }
+        frames_written += num_frames;
+        return fwrite(scratch.data(), 1, bytes, file) == bytes;
+    }
+
+    // Make everything written so far a complete, playable file
+    bool flush()
+    {
+        if (file == NULL) {
+            return false;
+        }
+        uint32_t data_bytes = (uint32_t)(frames_written * num_channels * (bit_depth / 8));
+        uint8_t size[4];
+        long end = ftell(file);
+        write_u32(size, 36 + data_bytes);
+        fseek(file, 4, SEEK_SET);
+        fwrite(size, 1, 4, file);
+        write_u32(size, data_bytes);
+        fseek(file, 40, SEEK_SET);
+        fwrite(size, 1, 4, file);
+        fseek(file, end, SEEK_SET);
+        return fflush(file) == 0;
+    }
+
+    bool close()
+    {
+        if (file == NULL) {
+            return true;
+        }
+        bool ok = flush();
+        ok = (fclose(file) == 0) && ok;
+        file = NULL;
+        return ok;
+    }
+
+    long long get_frames_written() const { return frames_written; }
+
+private:
+    static void write_u16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+    static void write_u32(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24); }
+
+    FILE* file = NULL;
+    int num_channels = 0;
+    int bit_depth = 16;
+    long long frames_written = 0;
+    std::vector<uint8_t> scratch;
+};
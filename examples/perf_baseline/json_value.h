@@ -0,0 +1,240 @@
+#pragma once
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/*
+
+Just enough of a JSON reader for the output of the benchmark tools and for stored baselines.
+Numbers are read as doubles and strings only understand the simple escapes. parse_json() returns
+false, and leaves an error message, when the text is not valid JSON.
+
+*/
+
+struct JsonValue
+{
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+    Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> members;     // in the order they were read
+
+    // The member with this name, or NULL
+    const JsonValue* get(const std::string& name) const
+    {
+        for (const auto& member : members) {
+            if (member.first == name) {
+                return &member.second;
+            }
+        }
+        return NULL;
+    }
+
+    double get_number(const std::string& name, double fallback = 0) const
+    {
+        const JsonValue* value = get(name);
+        return value != NULL && value->type == JSON_NUMBER ? value->number : fallback;
+    }
+
+    std::string get_string(const std::string& name, const std::string& fallback = "") const
+    {
+        const JsonValue* value = get(name);
+        return value != NULL && value->type == JSON_STRING ? value->string : fallback;
+    }
+};
+
+class JsonParser
+{
+public:
+    JsonParser(const std::string& text) : text(text) {}
+
+    bool parse(JsonValue& value)
+    {
+        if (!parse_value(value)) {
+            return false;
+        }
+        skip_space();
+        if (position != text.size()) {
+            return fail("unexpected text after the end of the document");
+        }
+        return true;
+    }
+
+    const std::string& get_error() const { return error; }
+
+private:
+    void skip_space()
+    {
+        while (position < text.size() && isspace((unsigned char)text[position])) {
+            position++;
+        }
+    }
+
+    bool fail(const std::string& message)
+    {
+        if (error.empty()) {
+            error = message + " at offset " + std::to_string(position);
+        }
+        return false;
+    }
+
+    bool expect(const char* literal)
+    {
+        size_t length = strlen(literal);
+        if (text.compare(position, length, literal) != 0) {
+            return fail(std::string("expected ") + literal);
+        }
+        position += length;
+        return true;
+    }
+
+    bool parse_value(JsonValue& value)
+    {
+        skip_space();
+        if (position >= text.size()) {
+            return fail("unexpected end of the document");
+        }
+        char c = text[position];
+        if (c == '{') {
+            return parse_object(value);
+        }
+        if (c == '[') {
+            return parse_array(value);
+        }
+        if (c == '"') {
+            value.type = JsonValue::JSON_STRING;
+            return parse_string(value.string);
+        }
+        if (c == 't' || c == 'f') {
+            value.type = JsonValue::JSON_BOOL;
+            value.boolean = c == 't';
+            return expect(c == 't' ? "true" : "false");
+        }
+        if (c == 'n') {
+            value.type = JsonValue::JSON_NULL;
+            return expect("null");
+        }
+        const char* start = text.c_str() + position;
+        char* end = NULL;
+        value.number = strtod(start, &end);
+        if (end == start) {
+            return fail("expected a value");
+        }
+        value.type = JsonValue::JSON_NUMBER;
+        position += end - start;
+        return true;
+    }
+
+    bool parse_string(std::string& out)
+    {
+        position++; // opening quote
+        while (position < text.size() && text[position] != '"') {
+            char c = text[position++];
+            if (c == '\\' && position < text.size()) {
+                char escaped = text[position++];
+                switch (escaped) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                default: c = escaped; break;
+                }
+            }
+            out += c;
+        }
+        if (position >= text.size()) {
+            return fail("unterminated string");
+        }
+        position++; // closing quote
+        return true;
+    }
+
+    bool parse_array(JsonValue& value)
+    {
+        value.type = JsonValue::JSON_ARRAY;
+        position++;
+        skip_space();
+        if (position < text.size() && text[position] == ']') {
+            position++;
+            return true;
+        }
+        while (true) {
+            value.array.emplace_back();
+            if (!parse_value(value.array.back())) {
+                return false;
+            }
+            skip_space();
+            if (position < text.size() && text[position] == ',') {
+                position++;
+            }
+            else if (position < text.size() && text[position] == ']') {
+                position++;
+                return true;
+            }
+            else {
+                return fail("expected , or ]");
+            }
+        }
+    }
+
+    bool parse_object(JsonValue& value)
+    {
+        value.type = JsonValue::JSON_OBJECT;
+        position++;
+        skip_space();
+        if (position < text.size() && text[position] == '}') {
+            position++;
+            return true;
+        }
+        while (true) {
+            skip_space();
+            if (position >= text.size() || text[position] != '"') {
+                return fail("expected a member name");
+            }
+            std::string name;
+            if (!parse_string(name)) {
+                return false;
+            }
+            skip_space();
+            if (position >= text.size() || text[position] != ':') {
+                return fail("expected :");
+            }
+            position++;
+            value.members.emplace_back(name, JsonValue());
+            if (!parse_value(value.members.back().second)) {
+                return false;
+            }
+            skip_space();
+            if (position < text.size() && text[position] == ',') {
+                position++;
+            }
+            else if (position < text.size() && text[position] == '}') {
+                position++;
+                return true;
+            }
+            else {
+                return fail("expected , or }");
+            }
+        }
+    }
+
+    const std::string& text;
+    size_t position = 0;
+    std::string error;
+};
+
+inline bool parse_json(const std::string& text, JsonValue& value, std::string& error)
+{
+    JsonParser parser(text);
+    if (!parser.parse(value)) {
+        error = parser.get_error();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,387 @@
+#include "json_value.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+#ifndef IMM_CLEARVOICE_BENCH
+#define IMM_CLEARVOICE_BENCH "clearvoice_bench"
+#endif
+#ifndef IMM_MIXING_BENCH
+#define IMM_MIXING_BENCH "3d_mixing_bench"
+#endif
+
+/*
+
+This command line tool runs a fixed benchmark matrix, stores the results as a baseline and
+flags slowdowns against a previous baseline.
+
+The matrix is clearvoice_bench at every sample rate, and 3d_mixing_bench with 2, 8 and 32
+participants at spatial_quality 1, 3 and 5, both on the bundled audio files. Each benchmark
+executable is run --repeats times, so every configuration gets one mean time per repeat. The
+repeats are saved with --save as a JSON baseline, tagged with --label (for example the SDK
+version) and a format version.
+
+With --baseline, every configuration is compared with the same configuration in the stored
+baseline. The tool prints the change in mean time with its 95% confidence interval, from
+Welch's t-test over the repeats. A configuration is flagged as slower when the whole interval
+is above zero and the change is larger than --threshold percent, and the tool then exits with 1.
+
+SYNTAX:
+perf_baseline <licensefile> [--repeats N] [--label TEXT] [--save FILE] [--baseline FILE] [--threshold PCT] [--quick]
+              [--clearvoice-bench PATH] [--mixing-bench PATH]
+
+*/
+
+static const int BASELINE_FORMAT_VERSION = 1;
+
+// One configuration of one benchmark, with one value per repeat
+struct BenchmarkSeries
+{
+    std::string name;
+    std::string metric;
+    std::vector<double> samples;
+};
+
+static double mean_of(const std::vector<double>& samples)
+{
+    double sum = 0;
+    for (double value : samples) {
+        sum += value;
+    }
+    return samples.empty() ? 0 : sum / samples.size();
+}
+
+static double variance_of(const std::vector<double>& samples)
+{
+    if (samples.size() < 2) {
+        return 0;
+    }
+    double mean = mean_of(samples);
+    double sum = 0;
+    for (double value : samples) {
+        sum += (value - mean) * (value - mean);
+    }
+    return sum / (samples.size() - 1);
+}
+
+// Two-sided 95% quantile of Student's t distribution
+static double t_quantile_95(double degrees_of_freedom)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    int df = std::max(1, (int)floor(degrees_of_freedom));
+    if (df <= 30) {
+        return table[df - 1];
+    }
+    if (df <= 60) {
+        return 2.042 - (df - 30) * (2.042 - 2.000) / 30.0;
+    }
+    if (df <= 120) {
+        return 2.000 - (df - 60) * (2.000 - 1.980) / 60.0;
+    }
+    return 1.960;
+}
+
+// Runs a command and returns what it printed on stdout
+static bool run_command(const std::string& command, std::string& output)
+{
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == NULL) {
+        return false;
+    }
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        output.append(buffer, count);
+    }
+    return pclose(pipe) == 0;
+}
+
+static std::string quote(const std::string& argument)
+{
+    return "\"" + argument + "\"";
+}
+
+// Adds one run of a benchmark executable to the series, creating them on the first run
+static bool add_run(const JsonValue& run, std::vector<BenchmarkSeries>& series)
+{
+    const JsonValue* results = run.get("results");
+    if (results == NULL || results->type != JsonValue::JSON_ARRAY) {
+        std::cout << "The benchmark output has no results" << std::endl;
+        return false;
+    }
+    std::string benchmark = run.get_string("benchmark");
+    for (const JsonValue& result : results->array) {
+        std::string name;
+        std::string metric;
+        if (benchmark == "clearvoice") {
+            name = "clearvoice sample_rate=" + std::to_string((int)result.get_number("sample_rate"));
+            metric = "ns_per_frame_mean";
+        }
+        else if (benchmark == "3d_mixing") {
+            name = "3d_mixing spatial_quality=" + std::to_string((int)result.get_number("spatial_quality"))
+                 + " participants=" + std::to_string((int)result.get_number("participants"));
+            metric = "ns_per_block_mean";
+        }
+        else {
+            std::cout << "Unknown benchmark " << benchmark << std::endl;
+            return false;
+        }
+        auto existing = std::find_if(series.begin(), series.end(), [&](const BenchmarkSeries& s) { return s.name == name; });
+        if (existing == series.end()) {
+            series.push_back({ name, metric, {} });
+            existing = series.end() - 1;
+        }
+        existing->samples.push_back(result.get_number(metric));
+    }
+    return true;
+}
+
+static bool save_baseline(const char* path, const std::string& label, int repeats, const std::vector<BenchmarkSeries>& series)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        std::cout << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    char created[64];
+    time_t now = time(NULL);
+    strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(file, "{\n  \"format_version\": %d,\n  \"label\": \"%s\",\n  \"created\": \"%s\",\n  \"repeats\": %d,\n  \"benchmarks\": [",
+            BASELINE_FORMAT_VERSION, label.c_str(), created, repeats);
+    for (size_t i = 0; i < series.size(); i++) {
+        const BenchmarkSeries& s = series[i];
+        fprintf(file, "%s\n    { \"name\": \"%s\", \"metric\": \"%s\", \"mean\": %.10g, \"stddev\": %.10g, \"samples\": [",
+                i == 0 ? "" : ",", s.name.c_str(), s.metric.c_str(), mean_of(s.samples), sqrt(variance_of(s.samples)));
+        for (size_t r = 0; r < s.samples.size(); r++) {
+            fprintf(file, "%s%.10g", r == 0 ? "" : ", ", s.samples[r]);
+        }
+        fprintf(file, "] }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+static bool load_baseline(const char* path, std::string& label, std::map<std::string, BenchmarkSeries>& series)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Failed to open baseline " << path << std::endl;
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    JsonValue baseline;
+    std::string error;
+    if (!parse_json(text.str(), baseline, error)) {
+        std::cout << "Failed to read baseline " << path << ": " << error << std::endl;
+        return false;
+    }
+    int version = (int)baseline.get_number("format_version");
+    if (version != BASELINE_FORMAT_VERSION) {
+        std::cout << "Baseline " << path << " has format version " << version << ", expected " << BASELINE_FORMAT_VERSION << std::endl;
+        return false;
+    }
+    label = baseline.get_string("label");
+    const JsonValue* benchmarks = baseline.get("benchmarks");
+    if (benchmarks == NULL || benchmarks->type != JsonValue::JSON_ARRAY) {
+        std::cout << "Baseline " << path << " has no benchmarks" << std::endl;
+        return false;
+    }
+    for (const JsonValue& benchmark : benchmarks->array) {
+        BenchmarkSeries s;
+        s.name = benchmark.get_string("name");
+        s.metric = benchmark.get_string("metric");
+        const JsonValue* samples = benchmark.get("samples");
+        if (samples != NULL) {
+            for (const JsonValue& sample : samples->array) {
+                s.samples.push_back(sample.number);
+            }
+        }
+        series[s.name] = s;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \nperf_baseline <licensefile> [--repeats N] [--label TEXT] [--save FILE] [--baseline FILE] [--threshold PCT] [--quick] [--clearvoice-bench PATH] [--mixing-bench PATH]" << std::endl;
+        std::cout << "  --repeats N              Times each benchmark is run (default 5)" << std::endl;
+        std::cout << "  --label TEXT             Name of this baseline, such as the SDK version (default: unlabeled)" << std::endl;
+        std::cout << "  --save FILE              Store the results as a baseline in FILE" << std::endl;
+        std::cout << "  --baseline FILE          Compare the results with the baseline stored in FILE" << std::endl;
+        std::cout << "  --threshold PCT          Smallest slowdown in percent that is flagged (default 3)" << std::endl;
+        std::cout << "  --quick                  Time fewer frames and blocks per run, for a rough check" << std::endl;
+        std::cout << "  --clearvoice-bench PATH  clearvoice_bench executable (default: the one built with this tool)" << std::endl;
+        std::cout << "  --mixing-bench PATH      3d_mixing_bench executable (default: the one built with this tool)" << std::endl;
+        return 1;
+    }
+
+    const char* license_filepath = argv[1];
+    int repeats = 5;
+    std::string label = "unlabeled";
+    const char* save_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold = 3.0;
+    bool quick = false;
+    std::string clearvoice_bench = IMM_CLEARVOICE_BENCH;
+    std::string mixing_bench = IMM_MIXING_BENCH;
+    for (int a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--repeats") == 0 && a + 1 < argc) {
+            repeats = std::max(1, atoi(argv[++a]));
+        }
+        else if (strcmp(argv[a], "--label") == 0 && a + 1 < argc) {
+            label = argv[++a];
+        }
+        else if (strcmp(argv[a], "--save") == 0 && a + 1 < argc) {
+            save_path = argv[++a];
+        }
+        else if (strcmp(argv[a], "--baseline") == 0 && a + 1 < argc) {
+            baseline_path = argv[++a];
+        }
+        else if (strcmp(argv[a], "--threshold") == 0 && a + 1 < argc) {
+            threshold = atof(argv[++a]);
+        }
+        else if (strcmp(argv[a], "--quick") == 0) {
+            quick = true;
+        }
+        else if (strcmp(argv[a], "--clearvoice-bench") == 0 && a + 1 < argc) {
+            clearvoice_bench = argv[++a];
+        }
+        else if (strcmp(argv[a], "--mixing-bench") == 0 && a + 1 < argc) {
+            mixing_bench = argv[++a];
+        }
+        else {
+            std::cout << "Unknown option " << argv[a] << std::endl;
+            return 1;
+        }
+    }
+
+    // Load the previous baseline first, so a bad path fails before the long benchmark runs
+    std::string baseline_label;
+    std::map<std::string, BenchmarkSeries> baseline;
+    if (baseline_path != NULL && !load_baseline(baseline_path, baseline_label, baseline)) {
+        return 1;
+    }
+
+    // The fixed matrix. Every repeat runs each executable once, so slow drifts of the machine
+    // spread over all configurations instead of landing on one of them.
+    std::vector<std::string> commands = {
+        quote(clearvoice_bench) + " " + quote(license_filepath) + (quick ? " --frames 1000 --warmup 50" : ""),
+        quote(mixing_bench) + " " + quote(license_filepath)
+            + " --participants 2 --participants 8 --participants 32 --quality 1 --quality 3 --quality 5"
+            + (quick ? " --blocks 200 --warmup 20" : ""),
+    };
+    std::vector<BenchmarkSeries> series;
+    for (int r = 0; r < repeats; r++) {
+        std::cout << "Repeat " << r + 1 << " of " << repeats << std::endl;
+        for (const std::string& command : commands) {
+            std::string output;
+            if (!run_command(command, output)) {
+                std::cout << "Failed to run " << command << std::endl;
+                return 1;
+            }
+            JsonValue run;
+            std::string error;
+            if (!parse_json(output, run, error)) {
+                std::cout << "Failed to read the output of " << command << ": " << error << std::endl;
+                return 1;
+            }
+            if (!add_run(run, series)) {
+                return 1;
+            }
+        }
+    }
+
+    if (save_path != NULL) {
+        if (!save_baseline(save_path, label, repeats, series)) {
+            return 1;
+        }
+        std::cout << "Saved baseline " << label << " to " << save_path << std::endl;
+    }
+
+    // Without a baseline, just print the means
+    char line[256];
+    if (baseline_path == NULL) {
+        snprintf(line, sizeof(line), "%-44s %14s %12s", "benchmark", "mean (us)", "stddev (us)");
+        std::cout << line << std::endl;
+        for (const BenchmarkSeries& s : series) {
+            snprintf(line, sizeof(line), "%-44s %14.2f %12.2f", s.name.c_str(), mean_of(s.samples) / 1000.0, sqrt(variance_of(s.samples)) / 1000.0);
+            std::cout << line << std::endl;
+        }
+        return 0;
+    }
+
+    std::cout << "Compared with baseline " << baseline_label << " (" << baseline_path << ")" << std::endl;
+    snprintf(line, sizeof(line), "%-44s %14s %14s %9s %20s  %s", "benchmark", "baseline (us)", "now (us)", "change", "95% interval", "verdict");
+    std::cout << line << std::endl;
+    int slower = 0;
+    for (const BenchmarkSeries& s : series) {
+        auto previous = baseline.find(s.name);
+        if (previous == baseline.end() || previous->second.samples.empty()) {
+            snprintf(line, sizeof(line), "%-44s %14s %14.2f %9s %20s  %s", s.name.c_str(), "-", mean_of(s.samples) / 1000.0, "", "", "new");
+            std::cout << line << std::endl;
+            continue;
+        }
+        const std::vector<double>& old_samples = previous->second.samples;
+        double old_mean = mean_of(old_samples);
+        double new_mean = mean_of(s.samples);
+        double change = 100.0 * (new_mean - old_mean) / old_mean;
+
+        // Welch's t-test, the two baselines need not have the same variance or number of repeats
+        std::string verdict;
+        char interval[64] = "";
+        if (old_samples.size() < 2 || s.samples.size() < 2) {
+            verdict = "needs 2+ repeats";
+        }
+        else {
+            double a = variance_of(old_samples) / old_samples.size();
+            double b = variance_of(s.samples) / s.samples.size();
+            double standard_error = sqrt(a + b);
+            double df = a + b > 0 ? (a + b) * (a + b) / (a * a / (old_samples.size() - 1) + b * b / (s.samples.size() - 1)) : 1e9;
+            double margin = 100.0 * t_quantile_95(df) * standard_error / old_mean;
+            snprintf(interval, sizeof(interval), "[%+.1f%%, %+.1f%%]", change - margin, change + margin);
+            if (change - margin > 0 && change > threshold) {
+                verdict = "SLOWER";
+                slower++;
+            }
+            else if (change + margin < 0 && -change > threshold) {
+                verdict = "faster";
+            }
+            else {
+                verdict = "same";
+            }
+        }
+        snprintf(line, sizeof(line), "%-44s %14.2f %14.2f %+8.1f%% %20s  %s", s.name.c_str(), old_mean / 1000.0, new_mean / 1000.0,
+                 change, interval, verdict.c_str());
+        std::cout << line << std::endl;
+    }
+
+    if (slower > 0) {
+        std::cout << slower << " benchmarks are significantly slower than baseline " << baseline_label << std::endl;
+        return 1;
+    }
+    std::cout << "No significant slowdowns" << std::endl;
+    return 0;
+}
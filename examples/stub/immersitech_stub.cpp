@@ -0,0 +1,620 @@
+#include "immersitech.h"
+#include "immersitech_clearvoice.h"
+#include "immersitech_logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+
+Stub implementation of the Immersitech ClearVoice and SpatialVoice APIs used by the examples.
+
+It does no audio processing. ClearVoice copies its input to its output and a room gives every
+participant the sum of the other participants' input, both optionally delayed. Each call burns
+a configurable amount of CPU time and every handle or participant holds a configurable amount
+of memory, so harness changes (I/O, threading, reblocking) can be measured reproducibly
+without a license. Settings are read from the environment once, see readme.md.
+
+*/
+
+namespace {
+
+struct StubSettings
+{
+    double cv_cost_us = 0;          // IMM_STUB_CV_COST_US: CPU time per imm_cv_process call
+    double input_cost_us = 0;       // IMM_STUB_INPUT_COST_US: CPU time per imm_input_audio_* call
+    double output_cost_us = 0;      // IMM_STUB_OUTPUT_COST_US: CPU time per imm_output_audio_* call
+    double mix_cost_us = 0;         // IMM_STUB_MIX_COST_US: extra output time per mixed source at spatial_quality 3
+    double position_cost_us = 0;    // IMM_STUB_POSITION_COST_US: CPU time per imm_set_participant_position call
+    int latency_samples = 0;        // IMM_STUB_LATENCY_SAMPLES: output delay, in output samples
+    size_t memory_kb = 0;           // IMM_STUB_MEMORY_KB: memory held per ClearVoice handle and per participant
+
+    StubSettings()
+    {
+        cv_cost_us = read_double("IMM_STUB_CV_COST_US");
+        input_cost_us = read_double("IMM_STUB_INPUT_COST_US");
+        output_cost_us = read_double("IMM_STUB_OUTPUT_COST_US");
+        mix_cost_us = read_double("IMM_STUB_MIX_COST_US");
+        position_cost_us = read_double("IMM_STUB_POSITION_COST_US");
+        latency_samples = std::max(0, (int)read_double("IMM_STUB_LATENCY_SAMPLES"));
+        memory_kb = (size_t)std::max(0.0, read_double("IMM_STUB_MEMORY_KB"));
+    }
+
+    static double read_double(const char* name)
+    {
+        const char* value = getenv(name);
+        return value != NULL ? atof(value) : 0.0;
+    }
+};
+
+const StubSettings& settings()
+{
+    static const StubSettings instance;
+    return instance;
+}
+
+bool logging_enabled = false;
+imm_log_level log_level = IMM_LOG_ERROR;
+
+void log_message(imm_log_level level, const char* message, int value = 0)
+{
+    if (logging_enabled && level <= log_level) {
+        fprintf(stderr, "[immersitech stub] %s %d\n", message, value);
+    }
+}
+
+// Spin on real arithmetic so the time shows up as CPU load rather than sleep
+void burn_cpu(double microseconds)
+{
+    if (microseconds <= 0) {
+        return;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(microseconds));
+    volatile float sink = 0;
+    do {
+        float acc = sink;
+        for (int i = 0; i < 64; i++) {
+            acc = acc * 0.999f + 1.0f;
+        }
+        sink = acc;
+    } while (std::chrono::steady_clock::now() < end);
+}
+
+// Memory that is written once so it really counts towards the resident set
+std::unique_ptr<char[]> allocate_footprint()
+{
+    size_t bytes = settings().memory_kb * 1024;
+    if (bytes == 0) {
+        return nullptr;
+    }
+    std::unique_ptr<char[]> memory(new char[bytes]);
+    memset(memory.get(), 1, bytes);
+    return memory;
+}
+
+// Fixed delay of latency_samples samples
+class DelayLine
+{
+public:
+    explicit DelayLine(int latency) : buffer(latency, 0.0f) {}
+
+    void process(float* samples, int count)
+    {
+        if (buffer.empty()) {
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            float delayed = buffer[position];
+            buffer[position] = samples[i];
+            samples[i] = delayed;
+            position = (position + 1) % buffer.size();
+        }
+    }
+
+private:
+    std::vector<float> buffer;
+    size_t position = 0;
+};
+
+// Nearest-sample rate conversion, good enough for predictable test output
+void convert_rate(const float* input, int input_frames, float* output, int output_frames)
+{
+    for (int i = 0; i < output_frames; i++) {
+        output[i] = input[std::min(input_frames - 1, (int)((long long)i * input_frames / output_frames))];
+    }
+}
+
+// Make sure nobody mistakes the stub's output for processed audio
+void announce_stub()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        fprintf(stderr, "NOTE: running against the Immersitech stub library, audio is not processed\n");
+    });
+}
+
+bool is_valid_rate(int rate)
+{
+    return rate == 8000 || rate == 16000 || rate == 24000 || rate == 32000 || rate == 48000;
+}
+
+/* ClearVoice */
+
+struct ClearVoiceStub
+{
+    imm_cv_config config;
+    DelayLine delay;
+    std::vector<float> scratch;
+    std::unique_ptr<char[]> footprint;
+
+    explicit ClearVoiceStub(imm_cv_config config)
+        : config(config), delay(settings().latency_samples), scratch(config.output_sample_rate / 100), footprint(allocate_footprint())
+    {
+    }
+};
+
+/* SpatialVoice */
+
+struct Participant
+{
+    imm_participant_configuration config;
+    int input_frames;
+    std::vector<float> input;           // last input, mono, at the output rate
+    long long input_cycle = -1;         // room cycle the input belongs to
+    std::vector<float> mix;
+    DelayLine delay;
+    int state[IMM_CONTROL_COUNT] = { 0 };
+    imm_position position = { 0, 0, 0 };
+    imm_heading heading = { 0, 0 };
+    std::unique_ptr<char[]> footprint;
+
+    Participant(imm_participant_configuration config, const imm_library_configuration& library)
+        : config(config),
+          input_frames((int)((long long)library.output_number_frames * config.input_sampling_rate / library.output_sampling_rate)),
+          input(library.output_number_frames, 0.0f),
+          mix(library.output_number_frames, 0.0f),
+          delay(settings().latency_samples),
+          footprint(allocate_footprint())
+    {
+    }
+};
+
+struct Room
+{
+    std::map<int, std::unique_ptr<Participant>> participants;
+    std::vector<float> scratch;
+
+    // A new cycle starts with the first input after any output, so inputs are only mixed
+    // into the outputs of the cycle they were given in
+    long long cycle = 0;
+    bool output_seen = false;
+};
+
+typedef std::map<int, Room*> RoomIndex;
+
+struct Library
+{
+    imm_library_configuration config;
+
+    // Rooms are only created and destroyed under rooms_mutex. Every other call looks its room up
+    // in room_index, a snapshot that is never changed, only replaced, so audio calls take no
+    // lock. Replaced snapshots are kept until the library is destroyed, since a lookup may
+    // still be reading one.
+    std::mutex rooms_mutex;
+    std::map<int, std::unique_ptr<Room>> rooms;
+    std::atomic<const RoomIndex*> room_index{NULL};
+    std::vector<std::unique_ptr<RoomIndex>> room_indexes;
+
+    // Called with rooms_mutex held, after rooms changed
+    void publish_rooms()
+    {
+        std::unique_ptr<RoomIndex> index(new RoomIndex());
+        for (auto& entry : rooms) {
+            (*index)[entry.first] = entry.second.get();
+        }
+        room_index.store(index.get(), std::memory_order_release);
+        room_indexes.push_back(std::move(index));
+    }
+};
+
+Room* find_room(imm_handle handle, int room_id)
+{
+    Library* library = (Library*)handle;
+    const RoomIndex* index = library->room_index.load(std::memory_order_acquire);
+    if (index == NULL) {
+        return NULL;
+    }
+    auto it = index->find(room_id);
+    return it == index->end() ? NULL : it->second;
+}
+
+Participant* find_participant(Room* room, int participant_id)
+{
+    auto it = room->participants.find(participant_id);
+    return it == room->participants.end() ? NULL : it->second.get();
+}
+
+imm_error_code input_audio(imm_handle handle, int room_id, int participant_id, const float* audio, int number_frames)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Library* library = (Library*)handle;
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    Participant* participant = find_participant(room, participant_id);
+    if (participant == NULL) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    if (number_frames != participant->input_frames) {
+        return IMM_ERROR_INVALID_CONFIGURATION;
+    }
+
+    burn_cpu(settings().input_cost_us);
+
+    if (room->output_seen) {
+        room->cycle++;
+        room->output_seen = false;
+    }
+
+    // Downmix to mono at the input rate, then convert to the output rate
+    int channels = participant->config.input_number_channels;
+    room->scratch.resize(number_frames);
+    for (int i = 0; i < number_frames; i++) {
+        float sum = 0;
+        for (int c = 0; c < channels; c++) {
+            sum += library->config.interleaved ? audio[i * channels + c] : audio[c * number_frames + i];
+        }
+        room->scratch[i] = sum / channels;
+    }
+    convert_rate(room->scratch.data(), number_frames, participant->input.data(), library->config.output_number_frames);
+    participant->input_cycle = room->cycle;
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code output_audio(imm_handle handle, int room_id, int participant_id, float* output)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Library* library = (Library*)handle;
+    const imm_library_configuration& config = library->config;
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    Participant* listener = find_participant(room, participant_id);
+    if (listener == NULL) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    room->output_seen = true;
+
+    // Everyone else who input audio this cycle is heard by this participant
+    std::fill(listener->mix.begin(), listener->mix.end(), 0.0f);
+    int sources = 0;
+    bool room_has_input = false;
+    for (auto& entry : room->participants) {
+        Participant* source = entry.second.get();
+        if (source->input_cycle != room->cycle) {
+            continue;
+        }
+        room_has_input = true;
+        if (source == listener || source->config.type == IMM_PARTICIPANT_LISTENER_ONLY) {
+            continue;
+        }
+        for (int i = 0; i < config.output_number_frames; i++) {
+            listener->mix[i] += source->input[i];
+        }
+        sources++;
+    }
+
+    burn_cpu(settings().output_cost_us + settings().mix_cost_us * sources * config.spatial_quality / 3.0);
+
+    listener->delay.process(listener->mix.data(), config.output_number_frames);
+    for (int i = 0; i < config.output_number_frames; i++) {
+        for (int c = 0; c < config.output_number_channels; c++) {
+            int index = config.interleaved ? i * config.output_number_channels + c : c * config.output_number_frames + i;
+            output[index] = listener->mix[i];
+        }
+    }
+    return room_has_input ? IMM_ERROR_NONE : IMM_ERROR_NO_INPUT_AUDIO;
+}
+
+short float_to_short(float sample)
+{
+    return (short)(std::max(-1.0f, std::min(1.0f, sample)) * 32767.0f);
+}
+
+} // namespace
+
+extern "C" {
+
+/* Logger */
+
+void imm_enable_logging(bool enable)
+{
+    logging_enabled = enable;
+}
+
+void imm_set_log_level(imm_log_level level)
+{
+    log_level = level;
+}
+
+/* ClearVoice */
+
+imm_cv_config imm_cv_get_default_config(void)
+{
+    imm_cv_config config;
+    config.input_sample_rate = 48000;
+    config.output_sample_rate = 48000;
+    return config;
+}
+
+imm_cv_handle imm_cv_init_from_file(const char* license_file_name, imm_cv_config config, imm_error_code* error_code)
+{
+    (void)license_file_name;
+    if (!is_valid_rate(config.input_sample_rate) || !is_valid_rate(config.output_sample_rate)) {
+        *error_code = IMM_ERROR_INVALID_CONFIGURATION;
+        return NULL;
+    }
+    announce_stub();
+    log_message(IMM_LOG_INFO, "ClearVoice stub initialized at sample rate", config.output_sample_rate);
+    *error_code = IMM_ERROR_NONE;
+    return new ClearVoiceStub(config);
+}
+
+imm_error_code imm_cv_process(imm_cv_handle handle, const float* input, float* output, imm_cv_output_metadata* metadata)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    ClearVoiceStub* cv = (ClearVoiceStub*)handle;
+    int input_frames = cv->config.input_sample_rate / 100;
+    int output_frames = cv->config.output_sample_rate / 100;
+
+    burn_cpu(settings().cv_cost_us);
+
+    bool voice = false;
+    for (int i = 0; i < input_frames && !voice; i++) {
+        voice = input[i] != 0.0f;
+    }
+    convert_rate(input, input_frames, cv->scratch.data(), output_frames);
+    cv->delay.process(cv->scratch.data(), output_frames);
+    memcpy(output, cv->scratch.data(), output_frames * sizeof(float));
+    if (metadata != NULL) {
+        metadata->voice_activity = voice ? 1 : 0;
+    }
+    return IMM_ERROR_NONE;
+}
+
+/* SpatialVoice */
+
+imm_handle imm_initialize_library(const char* license_file_name, const char* room_layout_file, const char* websocket_config_file,
+                                  imm_library_configuration configuration, imm_error_code* error_code)
+{
+    (void)license_file_name;
+    (void)room_layout_file;
+    (void)websocket_config_file;
+    if (!is_valid_rate(configuration.output_sampling_rate) || configuration.output_number_frames <= 0
+        || configuration.output_number_channels < 1 || configuration.output_number_channels > 2
+        || configuration.spatial_quality < 1 || configuration.spatial_quality > 5) {
+        *error_code = IMM_ERROR_INVALID_CONFIGURATION;
+        return NULL;
+    }
+    announce_stub();
+    Library* library = new Library();
+    library->config = configuration;
+    log_message(IMM_LOG_INFO, "SpatialVoice stub initialized at spatial quality", configuration.spatial_quality);
+    *error_code = IMM_ERROR_NONE;
+    return library;
+}
+
+imm_error_code imm_destroy_library(imm_handle handle)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    delete (Library*)handle;
+    return IMM_ERROR_NONE;
+}
+
+const char* imm_get_version(void)
+{
+    return "stub";
+}
+
+const char* imm_get_license_info(imm_handle handle)
+{
+    (void)handle;
+    return "Immersitech stub library: no license, no audio processing";
+}
+
+imm_error_code imm_create_room(imm_handle handle, int room_id)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Library* library = (Library*)handle;
+    std::lock_guard<std::mutex> lock(library->rooms_mutex);
+    if (library->rooms.count(room_id) > 0) {
+        return IMM_ERROR_ROOM_ALREADY_EXISTS;
+    }
+    library->rooms[room_id].reset(new Room());
+    library->publish_rooms();
+    log_message(IMM_LOG_DEBUG, "Created room", room_id);
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_destroy_room(imm_handle handle, int room_id)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Library* library = (Library*)handle;
+    std::lock_guard<std::mutex> lock(library->rooms_mutex);
+    auto it = library->rooms.find(room_id);
+    if (it == library->rooms.end()) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    // Out of the index first, so no new lookup finds the room while it is deleted
+    std::unique_ptr<Room> room = std::move(it->second);
+    library->rooms.erase(it);
+    library->publish_rooms();
+    log_message(IMM_LOG_DEBUG, "Destroyed room", room_id);
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_add_participant(imm_handle handle, int room_id, int participant_id, const char* participant_name,
+                                   imm_participant_configuration config)
+{
+    (void)participant_name;
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    if (!is_valid_rate(config.input_sampling_rate) || config.input_number_channels < 1 || config.input_number_channels > 2) {
+        return IMM_ERROR_INVALID_CONFIGURATION;
+    }
+    if (room->participants.count(participant_id) > 0) {
+        return IMM_ERROR_PARTICIPANT_ALREADY_EXISTS;
+    }
+    room->participants[participant_id].reset(new Participant(config, ((Library*)handle)->config));
+    log_message(IMM_LOG_DEBUG, "Added participant", participant_id);
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_remove_participant(imm_handle handle, int room_id, int participant_id)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    if (room->participants.erase(participant_id) == 0) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    log_message(IMM_LOG_DEBUG, "Removed participant", participant_id);
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_set_participant_state(imm_handle handle, int room_id, int participant_id, imm_audio_control control, int value)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    if (control < 0 || control >= IMM_CONTROL_COUNT) {
+        return IMM_ERROR_INVALID_CONTROL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    Participant* participant = find_participant(room, participant_id);
+    if (participant == NULL) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    participant->state[control] = value;
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_set_all_participants_state(imm_handle handle, int room_id, imm_audio_control control, int value)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    if (control < 0 || control >= IMM_CONTROL_COUNT) {
+        return IMM_ERROR_INVALID_CONTROL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    for (auto& entry : room->participants) {
+        entry.second->state[control] = value;
+    }
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_set_participant_position(imm_handle handle, int room_id, int participant_id, imm_position position, imm_heading heading)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    Participant* participant = find_participant(room, participant_id);
+    if (participant == NULL) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    participant->position = position;
+    participant->heading = heading;
+    burn_cpu(settings().position_cost_us);
+    return IMM_ERROR_NONE;
+}
+
+imm_error_code imm_input_audio_short(imm_handle handle, int room_id, int participant_id, const short* audio, int number_frames)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    Room* room = find_room(handle, room_id);
+    if (room == NULL) {
+        return IMM_ERROR_ROOM_NOT_FOUND;
+    }
+    Participant* participant = find_participant(room, participant_id);
+    if (participant == NULL) {
+        return IMM_ERROR_PARTICIPANT_NOT_FOUND;
+    }
+    thread_local std::vector<float> converted;
+    converted.resize((size_t)number_frames * participant->config.input_number_channels);
+    for (size_t i = 0; i < converted.size(); i++) {
+        converted[i] = audio[i] / 32768.0f;
+    }
+    return input_audio(handle, room_id, participant_id, converted.data(), number_frames);
+}
+
+imm_error_code imm_input_audio_float(imm_handle handle, int room_id, int participant_id, const float* audio, int number_frames)
+{
+    return input_audio(handle, room_id, participant_id, audio, number_frames);
+}
+
+imm_error_code imm_output_audio_short(imm_handle handle, int room_id, int participant_id, short* output)
+{
+    if (handle == NULL) {
+        return IMM_ERROR_HANDLE_NULL;
+    }
+    const imm_library_configuration& config = ((Library*)handle)->config;
+    thread_local std::vector<float> converted;
+    converted.resize((size_t)config.output_number_frames * config.output_number_channels);
+    imm_error_code error_code = output_audio(handle, room_id, participant_id, converted.data());
+    for (size_t i = 0; i < converted.size(); i++) {
+        output[i] = float_to_short(converted[i]);
+    }
+    return error_code;
+}
+
+imm_error_code imm_output_audio_float(imm_handle handle, int room_id, int participant_id, float* output)
+{
+    return output_audio(handle, room_id, participant_id, output);
+}
+
+} // extern "C"
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+
+Stand-in for the SpatialVoice SDK header. Declares only the subset of the API that the
+examples use; see examples/stub/readme.md. Build against the real SDK for real audio.
+
+*/
+
+#include "immersitech_errors.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* imm_handle;
+
+typedef struct imm_library_configuration {
+    int output_sampling_rate;       // 8000, 16000, 24000, 32000 or 48000
+    int output_number_frames;       // 480, 512, 960 or 1024
+    int output_number_channels;     // 1 or 2
+    bool interleaved;               // layout of stereo input and output buffers
+    int spatial_quality;            // 1 (fastest) to 5 (best)
+} imm_library_configuration;
+
+typedef enum imm_participant_type {
+    IMM_PARTICIPANT_REGULAR = 0,
+    IMM_PARTICIPANT_SOURCE_ONLY,
+    IMM_PARTICIPANT_LISTENER_ONLY
+} imm_participant_type;
+
+typedef struct imm_participant_configuration {
+    int input_sampling_rate;
+    int input_number_channels;
+    imm_participant_type type;
+} imm_participant_configuration;
+
+typedef enum imm_audio_control {
+    IMM_CONTROL_ANC_ENABLE = 0,
+    IMM_CONTROL_AGC_ENABLE,
+    IMM_CONTROL_AUTO_EQ_ENABLE,
+    IMM_CONTROL_DEVICE,
+    IMM_CONTROL_MIXING_3D_ENABLE,
+    IMM_CONTROL_MIXING_3D_ATTENUATION,
+    IMM_CONTROL_MIXING_3D_MAX_DISTANCE,
+    IMM_CONTROL_MIXING_3D_REVERB_ENABLE,
+    IMM_CONTROL_COUNT
+} imm_audio_control;
+
+typedef enum imm_device_type {
+    IMM_DEVICE_HEADPHONE = 0,
+    IMM_DEVICE_SPEAKER
+} imm_device_type;
+
+// Centimeters
+typedef struct imm_position {
+    int x;
+    int y;
+    int z;
+} imm_position;
+
+// Degrees
+typedef struct imm_heading {
+    int azimuth_heading;
+    int elevation_heading;
+} imm_heading;
+
+imm_handle imm_initialize_library(const char* license_file_name, const char* room_layout_file, const char* websocket_config_file,
+                                  imm_library_configuration configuration, imm_error_code* error_code);
+imm_error_code imm_destroy_library(imm_handle handle);
+
+const char* imm_get_version(void);
+const char* imm_get_license_info(imm_handle handle);
+
+imm_error_code imm_create_room(imm_handle handle, int room_id);
+imm_error_code imm_destroy_room(imm_handle handle, int room_id);
+
+imm_error_code imm_add_participant(imm_handle handle, int room_id, int participant_id, const char* participant_name,
+                                   imm_participant_configuration config);
+imm_error_code imm_remove_participant(imm_handle handle, int room_id, int participant_id);
+
+imm_error_code imm_set_participant_state(imm_handle handle, int room_id, int participant_id, imm_audio_control control, int value);
+imm_error_code imm_set_all_participants_state(imm_handle handle, int room_id, imm_audio_control control, int value);
+imm_error_code imm_set_participant_position(imm_handle handle, int room_id, int participant_id, imm_position position, imm_heading heading);
+
+// number_frames is the participant's input frames per buffer: output_number_frames * input_sampling_rate / output_sampling_rate
+imm_error_code imm_input_audio_short(imm_handle handle, int room_id, int participant_id, const short* audio, int number_frames);
+imm_error_code imm_input_audio_float(imm_handle handle, int room_id, int participant_id, const float* audio, int number_frames);
+
+// Writes output_number_frames frames of output_number_channels channels
+imm_error_code imm_output_audio_short(imm_handle handle, int room_id, int participant_id, short* output);
+imm_error_code imm_output_audio_float(imm_handle handle, int room_id, int participant_id, float* output);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+
+Stand-in for the ClearVoice SDK header. Declares only the subset of the ClearVoice API that
+the examples use; see examples/stub/readme.md. Build against the real SDK for real audio.
+
+*/
+
+#include "immersitech_errors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* imm_cv_handle;
+
+typedef struct imm_cv_config {
+    int input_sample_rate;      // 8000, 16000, 24000, 32000 or 48000
+    int output_sample_rate;     // 8000, 16000, 24000, 32000 or 48000
+} imm_cv_config;
+
+typedef struct imm_cv_output_metadata {
+    int voice_activity;         // the stub reports 1 for any frame that is not digital silence
+} imm_cv_output_metadata;
+
+imm_cv_config imm_cv_get_default_config(void);
+
+imm_cv_handle imm_cv_init_from_file(const char* license_file_name, imm_cv_config config, imm_error_code* error_code);
+
+// Processes exactly 10ms: input_sample_rate / 100 samples in, output_sample_rate / 100 samples out
+imm_error_code imm_cv_process(imm_cv_handle handle, const float* input, float* output, imm_cv_output_metadata* metadata);
+
+#ifdef __cplusplus
+}
+#endif
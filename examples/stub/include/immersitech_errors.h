@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+
+Error codes shared by the stand-in Immersitech headers, so a program can include both the
+ClearVoice and the SpatialVoice header.
+
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum imm_error_code {
+    IMM_ERROR_NONE = 0,
+    IMM_ERROR_NO_INPUT_AUDIO,
+    IMM_ERROR_HANDLE_NULL,
+    IMM_ERROR_INVALID_CONFIGURATION,
+    IMM_ERROR_ROOM_NOT_FOUND,
+    IMM_ERROR_ROOM_ALREADY_EXISTS,
+    IMM_ERROR_PARTICIPANT_NOT_FOUND,
+    IMM_ERROR_PARTICIPANT_ALREADY_EXISTS,
+    IMM_ERROR_INVALID_CONTROL
+} imm_error_code;
+
+#ifdef __cplusplus
+}
+#endif
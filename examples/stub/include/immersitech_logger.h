@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+
+Stand-in for the Immersitech logger header. See examples/stub/readme.md.
+
+*/
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum imm_log_level {
+    IMM_LOG_ERROR = 0,
+    IMM_LOG_WARNING,
+    IMM_LOG_INFO,
+    IMM_LOG_DEBUG
+} imm_log_level;
+
+void imm_enable_logging(bool enable);
+void imm_set_log_level(imm_log_level level);
+
+#ifdef __cplusplus
+}
+#endif